@@ -0,0 +1,620 @@
+//project fresa, 2017-2022
+//by jose pazos perez
+//licensed under GPLv3 uwu
+
+#include "benchmark.h"
+#include "game.h"
+#include "jobs.h"
+#include "f_time.h"
+#include "histogram.h"
+#include "input_recorder.h"
+#include "serialization.h"
+#include "scene_binary.h"
+#include "file.h"
+#include "events.h"
+#include "log.h"
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <new>
+#include <cstdlib>
+#include <memory>
+#include <algorithm>
+#include <random>
+#include <cctype>
+
+using namespace Fresa;
+
+#ifdef FRESA_BENCHMARK_ALLOCATIONS
+//---Allocation counter---
+//      Replaces the global allocation functions to count how many allocations happen in each tick
+namespace {
+    std::atomic<ui64> allocation_count = 0;
+    std::atomic<ui64> allocation_bytes = 0;
+
+    void* allocate(size_t size, size_t alignment) {
+        allocation_count.fetch_add(1, std::memory_order_relaxed);
+        allocation_bytes.fetch_add(size, std::memory_order_relaxed);
+        size = size > 0 ? size : 1;
+        void* p = alignment > alignof(std::max_align_t) ? std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment) : std::malloc(size);
+        if (p == nullptr)
+            throw std::bad_alloc();
+        return p;
+    }
+}
+
+void* operator new(size_t size) { return allocate(size, 0); }
+void* operator new[](size_t size) { return allocate(size, 0); }
+void* operator new(size_t size, std::align_val_t alignment) { return allocate(size, (size_t)alignment); }
+void* operator new[](size_t size, std::align_val_t alignment) { return allocate(size, (size_t)alignment); }
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+void operator delete[](void* p, size_t) noexcept { std::free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p, size_t, std::align_val_t) noexcept { std::free(p); }
+#endif
+
+namespace {
+    struct Counters {
+        ui64 allocations = 0;
+        ui64 bytes = 0;
+    };
+
+    Counters allocations() {
+        #ifdef FRESA_BENCHMARK_ALLOCATIONS
+        return Counters{allocation_count.load(std::memory_order_relaxed), allocation_bytes.load(std::memory_order_relaxed)};
+        #else
+        return Counters{};
+        #endif
+    }
+
+    void writeHistogram(std::ostringstream &out, const Histogram &h) {
+        out << "\"mean\": " << h.mean() << ", \"p50\": " << h.percentile(50.0) << ", \"p95\": " << h.percentile(95.0)
+            << ", \"p99\": " << h.percentile(99.0) << ", \"max\": " << h.max();
+    }
+
+    void writeFile(const str &result, const str &path) {
+        if (path.empty())
+            return;
+        std::ofstream file(path);
+        if (not file.is_open())
+            log::warn("Couldn't open the benchmark file %s", path.c_str());
+        file << result;
+    }
+}
+
+str Benchmark::run(const Options &options, str path) {
+    //---Benchmark---
+    //      Every tick fills the accumulator with exactly one timestep and advances the clocks by the same amount, instead of reading the
+    //      real time, so the number of physics iterations and the game time are the same in every run
+    SceneID previous_scene = active_scene;
+    SceneID scene_id = registerScene(options.name);
+    active_scene = scene_id;
+    Scene &scene = scene_list.at(scene_id);
+    if (options.setup != nullptr)
+        options.setup(scene);
+    scene.playbackCommands();
+    size_t entities = scene.getStats().alive;
+
+    Duration step = std::chrono::duration_cast<Duration>(std::chrono::duration<double, std::milli>(Config::getTimestep()));
+    ui32 total = options.warmup + options.ticks;
+    Time::current = time();
+    Time::previous = Time::current;
+
+    Histogram tick_histogram{};
+    std::vector<Histogram> system_histograms(System::physics_update_systems.size());
+    Counters start_counters{};
+    Duration measured{0};
+    ui32 ticks = 0;
+
+    for (ui32 i = 0; i < total; i++) {
+        if (i == options.warmup) {
+            start_counters = allocations();
+            if (not options.replay.empty()) {
+                if (not Input::startReplay(options.replay))
+                    break;
+                total = options.warmup + (ui32)Input::replayLength();
+            }
+        }
+
+        Profiler::frame();
+        Time::accumulator = Config::getTimestep() * 1.0e6; //: In nanoseconds, one physics iteration
+
+        Clock::time_point before = time();
+        if (not Game::physicsUpdate())
+            break;
+        Duration tick_time = time() - before;
+
+        //: Fixed simulated clock
+        Time::previous = Time::current;
+        Time::current += step;
+        Time::updateTimers();
+
+        if (i < options.warmup)
+            continue;
+        ticks++;
+        measured += tick_time;
+        tick_histogram.add(ms(tick_time));
+        for (size_t s = 0; s < system_histograms.size() and s < Performance::physics_system_time.size(); s++)
+            system_histograms.at(s).add(Performance::physics_system_time.at(s));
+    }
+    Counters end_counters = allocations();
+    Input::stopReplay();
+
+    //: Give the clocks back to the game loop
+    Time::current = time();
+    Time::previous = Time::current;
+    Time::accumulator = 0.0;
+    removeScene(scene_id);
+    active_scene = previous_scene;
+
+    //---Results---
+    std::ostringstream out;
+    out.precision(6);
+    out << std::fixed;
+
+    double seconds = sec(measured);
+    out << "{\n";
+    out << "  \"name\": \"" << options.name << "\",\n";
+    out << "  \"ticks\": " << ticks << ",\n";
+    out << "  \"entities\": " << entities << ",\n";
+    out << "  \"threads\": " << Jobs::threadCount() << ",\n";
+    out << "  \"seconds\": " << seconds << ",\n";
+    out << "  \"ticks_per_second\": " << (seconds > 0.0 ? (double)ticks / seconds : 0.0) << ",\n";
+    out << "  \"tick_ms\": { ";
+    writeHistogram(out, tick_histogram);
+    out << " },\n";
+
+    out << "  \"systems\": [";
+    size_t s = 0;
+    for (auto &[priority, system] : System::physics_update_systems) {
+        out << (s == 0 ? "\n" : ",\n") << "    { \"name\": \"" << system.name << "\", ";
+        writeHistogram(out, system_histograms.at(s++));
+        out << " }";
+    }
+    out << (s > 0 ? "\n  ],\n" : "],\n");
+
+    #ifdef FRESA_BENCHMARK_ALLOCATIONS
+    ui64 allocation_total = end_counters.allocations - start_counters.allocations;
+    out << "  \"allocations\": { \"count\": " << allocation_total
+        << ", \"bytes\": " << end_counters.bytes - start_counters.bytes
+        << ", \"per_tick\": " << (ticks > 0 ? (double)allocation_total / (double)ticks : 0.0) << " }\n";
+    #else
+    out << "  \"allocations\": null\n";
+    #endif
+    out << "}\n";
+
+    str result = out.str();
+    writeFile(result, path);
+    return result;
+}
+
+std::optional<int> Benchmark::command(int argc, char** argv) {
+    std::vector<str> args(argv + std::min(argc, 1), argv + argc);
+    auto value = [&](str flag, str fallback) -> str {
+        auto f = std::find(args.begin(), args.end(), flag);
+        return (f != args.end() and f + 1 != args.end()) ? *(f + 1) : fallback;
+    };
+
+    //: Scene tools, they only need the resource folder
+    auto convert = std::find(args.begin(), args.end(), "--convert-scene");
+    auto load = std::find(args.begin(), args.end(), "--loading");
+    if (convert != args.end() or load != args.end()) {
+        try {
+            File::init();
+            if (convert != args.end()) {
+                auto last = std::find_if(convert + 1, args.end(), [](const str &a){ return a.starts_with("--"); });
+                if (last == convert + 1)
+                    log::error("Missing the scenes to convert, use --convert-scene scene.fres [...]");
+                for (auto s = convert + 1; s != last; s++) {
+                    Serialization::convertScene(*s, *s + ".bin");
+                    std::cout << *s << " -> " << *s + ".bin" << std::endl;
+                }
+            }
+            if (load != args.end()) {
+                str scene = value("--loading", "");
+                if (scene.empty() or scene.starts_with("--"))
+                    log::error("Missing the scene of the loading benchmark, use --loading scene.fres (or an entity count to generate one)");
+                if (std::all_of(scene.begin(), scene.end(), [](char c){ return std::isdigit((unsigned char)c); }))
+                    scene = generateScene((ui32)std::stoul(scene));
+                std::cout << loading(scene, (ui32)std::stoul(value("--repeats", "10")), value("--output", ""));
+            }
+            return 0;
+        } catch (const std::exception &e) {
+            std::cerr << "The scene tool failed: " << e.what() << std::endl;
+            return 1;
+        }
+    }
+
+    auto it = std::find(args.begin(), args.end(), "--benchmark");
+    if (it == args.end())
+        return std::nullopt;
+
+    bool initialized = false;
+    try {
+        //: Arguments
+        Options options{};
+        str scene = (it + 1 != args.end()) ? *(it + 1) : "";
+        if (scene.empty() or scene.starts_with("--"))
+            log::error("Missing the scene of the benchmark, use --benchmark scene.fres (or - for an empty scene)");
+        str output = "";
+        for (size_t i = 0; i < args.size(); i++) {
+            bool has_value = i + 1 < args.size();
+            if (args.at(i) == "--ticks" and has_value)
+                options.ticks = (ui32)std::stoul(args.at(++i));
+            else if (args.at(i) == "--warmup" and has_value)
+                options.warmup = (ui32)std::stoul(args.at(++i));
+            else if (args.at(i) == "--replay" and has_value)
+                options.replay = args.at(++i);
+            else if (args.at(i) == "--output" and has_value)
+                output = args.at(++i);
+        }
+        options.name = scene;
+        if (scene != "-")
+            options.setup = [scene](Scene &s){ Serialization::loadScene(scene, s); };
+
+        //: Run
+        if (not Game::init(true))
+            return 1;
+        initialized = true;
+        std::cout << run(options, output);
+        Game::stop();
+        return 0;
+    } catch (const std::exception &e) {
+        std::cerr << "The benchmark failed: " << e.what() << std::endl;
+        if (initialized)
+            Game::stop();
+        return 1;
+    }
+}
+
+namespace {
+    //---Generated scene---
+    //      Member values for the loading benchmark scene, only numbers and vectors of numbers are written (as the text scenes expect them)
+    template <typename M> struct Number { using type = M; static constexpr int size = 1; };
+    template <typename A> struct Number<Vec2<A>> { using type = A; static constexpr int size = 2; };
+    template <typename A> struct Number<Rect2<A>> { using type = A; static constexpr int size = 4; };
+
+    template <typename M>
+    constexpr bool is_writable = std::is_arithmetic_v<typename Number<M>::type> and not std::is_same_v<typename Number<M>::type, bool>;
+
+    template <typename M>
+    void writeMember(std::ostream &out, ui32 i) {
+        using N = typename Number<M>::type;
+        out << (Number<M>::size > 1 ? "[" : "");
+        for (int j = 0; j < Number<M>::size; j++) {
+            out << (j > 0 ? ", " : "");
+            if constexpr (std::is_floating_point_v<N>)
+                out << (double)((i + j) % 1000) * 0.5;
+            else
+                out << (ui32)((i + j) % 100);
+        }
+        out << (Number<M>::size > 1 ? "]" : "");
+    }
+
+    //: Components that can be in both the text and binary scenes, trivially copyable and with only members that can be written
+    template <typename V>
+    struct WritableMembers;
+    template <typename... Ms>
+    struct WritableMembers<std::variant<Ms...>> { static constexpr bool value = (is_writable<Ms> and ...); };
+
+    template <typename C>
+    constexpr bool isGenerated() {
+        if constexpr (Reflection::is_reflectable<C> and std::is_trivially_copyable_v<C>)
+            return WritableMembers<Reflection::as_type_list<C>>::value;
+        else
+            return false;
+    }
+}
+
+str Benchmark::generateScene(ui32 entities) {
+    str file = "benchmark_" + std::to_string(entities) + ".fres";
+    std::ofstream out(File::path("data/scenes/") + file);
+    if (not out)
+        log::error("Failed to write the benchmark scene %s", file.c_str());
+
+    out << "scene benchmark_" << entities << "\n---\n";
+    for (ui32 i = 0; i < entities; i++) {
+        out << "entity e" << i << ":\n";
+        for_<Component::ComponentType>([&](auto c){
+            using C = std::variant_alternative_t<c.value, Component::ComponentType>;
+            if constexpr (isGenerated<C>()) {
+                out << "  " << lower(str(type_name<C>())) << ":\n";
+                for_<Reflection::as_type_list<C>>([&](auto j){
+                    out << "    " << C::member_names.at(j.value) << ": ";
+                    writeMember<std::variant_alternative_t<j.value, Reflection::as_type_list<C>>>(out, i);
+                    out << "\n";
+                });
+            }
+        });
+    }
+    return file;
+}
+
+str Benchmark::loading(str file, ui32 repeats, str path) {
+    str binary_file = file + ".bin";
+    Serialization::convertScene(file, binary_file);
+
+    //: Each load goes into a new scene, only the load is measured
+    Histogram text_histogram{};
+    Histogram binary_histogram{};
+    size_t entities = 0;
+    for (ui32 i = 0; i < repeats; i++) {
+        {
+            Scene scene;
+            Clock::time_point before = time();
+            Serialization::loadScene(file, scene);
+            text_histogram.add(ms(time() - before));
+        }
+        {
+            Scene scene;
+            Clock::time_point before = time();
+            Serialization::loadSceneBinary(binary_file, scene);
+            binary_histogram.add(ms(time() - before));
+            entities = scene.getStats().alive;
+        }
+    }
+
+    //---Results---
+    std::ostringstream out;
+    out.precision(6);
+    out << std::fixed;
+
+    double text_p50 = text_histogram.percentile(50.0);
+    double binary_p50 = binary_histogram.percentile(50.0);
+    out << "{\n";
+    out << "  \"name\": \"" << file << "\",\n";
+    out << "  \"entities\": " << entities << ",\n";
+    out << "  \"repeats\": " << repeats << ",\n";
+    out << "  \"text\": { \"bytes\": " << fs::file_size(File::path("data/scenes/" + file)) << ", ";
+    writeHistogram(out, text_histogram);
+    out << " },\n";
+    out << "  \"binary\": { \"bytes\": " << fs::file_size(File::path("data/scenes/" + binary_file)) << ", ";
+    writeHistogram(out, binary_histogram);
+    out << " },\n";
+    out << "  \"speedup\": " << (binary_p50 > 0.0 ? text_p50 / binary_p50 : 0.0) << "\n";
+    out << "}\n";
+
+    str result = out.str();
+    writeFile(result, path);
+    return result;
+}
+
+namespace {
+    struct StorageElement {
+        float x, y, z, w;
+    };
+}
+
+str Benchmark::storage(std::vector<ui32> counts, ui32 stride, ui32 repeats, str path) {
+    std::ostringstream out;
+    out.precision(6);
+    out << std::fixed;
+
+    stride = std::max(stride, 1u);
+    out << "{\n";
+    out << "  \"element_size\": " << sizeof(StorageElement) << ",\n";
+    out << "  \"stride\": " << stride << ",\n";
+    out << "  \"repeats\": " << repeats << ",\n";
+    out << "  \"counts\": [";
+
+    for (size_t c = 0; c < counts.size(); c++) {
+        ui32 count = counts.at(c);
+
+        //: Sparse set pool
+        std::unique_ptr<ComponentPool> pool(ComponentPool::create<StorageElement>());
+        for (ui32 i = 0; i < count; i += stride)
+            new (pool->add(Entity::createID(i, 0))) StorageElement{(float)i, 0.0f, 0.0f, 1.0f};
+
+        //: Dense layout, a slot for every entity and the masks to know which ones have the component
+        std::vector<StorageElement> dense(count);
+        std::vector<Signature> masks(count);
+        for (ui32 i = 0; i < count; i += stride) {
+            dense[i] = StorageElement{(float)i, 0.0f, 0.0f, 1.0f};
+            masks[i].set(0);
+        }
+
+        Histogram sparse_histogram{};
+        Histogram dense_histogram{};
+        for (ui32 r = 0; r < repeats; r++) {
+            Clock::time_point before = time();
+            for (size_t begin = 0; begin < pool->size(); begin += ComponentPool::page_size) {
+                StorageElement* page = static_cast<StorageElement*>(pool->at(begin));
+                size_t n = std::min<size_t>(ComponentPool::page_size, pool->size() - begin);
+                for (size_t i = 0; i < n; i++)
+                    page[i].x += page[i].w;
+            }
+            sparse_histogram.add(ms(time() - before));
+
+            before = time();
+            for (ui32 i = 0; i < count; i++)
+                if (masks[i].test(0))
+                    dense[i].x += dense[i].w;
+            dense_histogram.add(ms(time() - before));
+        }
+
+        out << (c == 0 ? "\n" : ",\n") << "    { \"entities\": " << count << ", \"components\": " << pool->size() << ",\n";
+        out << "      \"sparse\": { \"bytes\": " << pool->bytesReserved() << ", ";
+        writeHistogram(out, sparse_histogram);
+        out << " },\n";
+        out << "      \"dense\": { \"bytes\": " << dense.capacity() * sizeof(StorageElement) << ", ";
+        writeHistogram(out, dense_histogram);
+        out << " } }";
+    }
+    out << (counts.empty() ? "]\n" : "\n  ]\n");
+    out << "}\n";
+
+    str result = out.str();
+    writeFile(result, path);
+    return result;
+}
+
+str Benchmark::churn(ui64 operations, ui32 max_live, ui32 delay, str path) {
+    struct Policy {
+        str name;
+        Scene::RecyclePolicy policy;
+        ui32 delay;
+    };
+    std::vector<Policy> policies = {{"lifo", Scene::RECYCLE_LIFO, 0}, {"fifo", Scene::RECYCLE_FIFO, 0}, {"delayed", Scene::RECYCLE_FIFO, delay}};
+
+    std::ostringstream out;
+    out.precision(6);
+    out << std::fixed;
+
+    max_live = std::max(max_live, 1u);
+    out << "{\n";
+    out << "  \"operations\": " << operations << ",\n";
+    out << "  \"max_live\": " << max_live << ",\n";
+    out << "  \"policies\": [";
+
+    for (size_t p = 0; p < policies.size(); p++) {
+        Scene scene;
+        scene.recycle_policy = policies.at(p).policy;
+        scene.recycle_delay = policies.at(p).delay;
+
+        //: Same sequence for every policy, the live ids are removed in random order and the removed ones are kept to check them
+        std::mt19937_64 random(42);
+        std::vector<EntityID> live;
+        std::vector<EntityID> stale;
+        live.reserve(max_live);
+        stale.reserve(4096);
+        ui64 creates = 0, removes = 0, checks = 0;
+        size_t peak = 0;
+
+        Clock::time_point before = time();
+        for (ui64 i = 0; i < operations; i++) {
+            if (live.empty() or (live.size() < max_live and random() % 2 == 0)) {
+                live.push_back(scene.createEntity());
+                peak = std::max(peak, live.size());
+                creates++;
+            } else {
+                size_t index = random() % live.size();
+                EntityID eid = live.at(index);
+                live.at(index) = live.back();
+                live.pop_back();
+                scene.removeEntity(eid);
+                if (stale.size() < stale.capacity())
+                    stale.push_back(eid);
+                else
+                    stale.at(removes % stale.size()) = eid;
+                removes++;
+            }
+
+            //: A stale id is never valid, it would point to the entity that reused its slot
+            if (not stale.empty()) {
+                EntityID eid = stale.at(random() % stale.size());
+                if (scene.isValid(eid))
+                    log::error("Churn benchmark (%s): the stale entity %u (version %u) is valid", policies.at(p).name.c_str(),
+                               Entity::getIndex(eid), Entity::getVersion(eid));
+                checks++;
+            }
+
+            //: Removed slots are reused, so the list only grows past the peak by the indices that the delay holds back
+            if (scene.entities.size() > peak + policies.at(p).delay)
+                log::error("Churn benchmark (%s): %zu entity slots for a peak of %zu live entities", policies.at(p).name.c_str(),
+                           scene.entities.size(), peak);
+        }
+        double total = ms(time() - before);
+
+        out << (p == 0 ? "\n" : ",\n") << "    { \"policy\": \"" << policies.at(p).name << "\", \"delay\": " << policies.at(p).delay;
+        out << ", \"creates\": " << creates << ", \"removes\": " << removes << ", \"stale_checks\": " << checks;
+        out << ", \"peak_live\": " << peak << ", \"entities\": " << scene.entities.size();
+        out << ", \"ms\": " << total << ", \"ns_per_operation\": " << (operations > 0 ? total * 1.0e6 / (double)operations : 0.0) << " }";
+    }
+    out << (policies.empty() ? "]\n" : "\n  ]\n");
+    out << "}\n";
+
+    str result = out.str();
+    writeFile(result, path);
+    return result;
+}
+
+namespace {
+    //: Publishes an event with a number of observers that add the value to a counter, and writes the cost of each publish
+    template <typename E>
+    void publishCost(std::ostringstream &out, const str &name, ui32 observers, ui32 publishes) {
+        E event;
+        ui64 sum = 0;
+        std::vector<typename E::Observer> list;
+        list.reserve(observers);
+        for (ui32 i = 0; i < observers; i++)
+            list.push_back(event.createObserver([&sum](const int &v){ sum += v; }));
+
+        //: Warmup, the first publish may grow internal storage
+        event.publish(1);
+
+        Counters allocations_before = allocations();
+        Clock::time_point before = time();
+        for (ui32 i = 0; i < publishes; i++)
+            event.publish((int)i);
+        double total = ms(time() - before);
+        Counters allocations_after = allocations();
+
+        if (sum != (ui64)observers * (1 + (ui64)publishes * (publishes - 1) / 2))
+            log::error("Event benchmark (%s): the observers received %llu instead of the published values", name.c_str(), (unsigned long long)sum);
+
+        double count = (double)std::max(publishes, 1u);
+        out << "{ \"event\": \"" << name << "\", \"observers\": " << observers;
+        out << ", \"ns_per_publish\": " << total * 1.0e6 / count;
+        out << ", \"allocations_per_publish\": " << (double)(allocations_after.allocations - allocations_before.allocations) / count << " }";
+    }
+}
+
+str Benchmark::events(ui32 publishes, str path) {
+    std::ostringstream out;
+    out.precision(6);
+    out << std::fixed;
+
+    out << "{\n";
+    out << "  \"publishes\": " << publishes << ",\n";
+    #ifdef FRESA_BENCHMARK_ALLOCATIONS
+    out << "  \"allocations_counted\": true,\n";
+    #else
+    out << "  \"allocations_counted\": false,\n";
+    #endif
+    out << "  \"results\": [";
+
+    bool first = true;
+    for (ui32 observers : {0u, 1u, 10u, 100u}) {
+        out << (first ? "\n    " : ",\n    ");
+        publishCost<Event::LocalEvent<int>>(out, "LocalEvent", observers, publishes);
+        out << ",\n    ";
+        publishCost<Event::Event<int>>(out, "Event", observers, publishes);
+        first = false;
+    }
+    out << "\n  ]\n";
+    out << "}\n";
+
+    str result = out.str();
+    writeFile(result, path);
+    return result;
+}
+
+str Benchmark::scalingResults(const str &name, ui32 entities, ui32 passes, const std::vector<Histogram> &times, const str &path) {
+    std::ostringstream out;
+    out.precision(6);
+    out << std::fixed;
+
+    double single = times.empty() ? 0.0 : times.at(0).percentile(50.0);
+    out << "{\n";
+    out << "  \"name\": \"" << name << "\",\n";
+    out << "  \"entities\": " << entities << ",\n";
+    out << "  \"passes\": " << passes << ",\n";
+    out << "  \"threads\": [";
+    for (size_t i = 0; i < times.size(); i++) {
+        double p50 = times.at(i).percentile(50.0);
+        out << (i == 0 ? "\n" : ",\n") << "    { \"threads\": " << i + 1 << ", ";
+        writeHistogram(out, times.at(i));
+        out << ", \"speedup\": " << (p50 > 0.0 ? single / p50 : 0.0) << " }";
+    }
+    out << (times.empty() ? "]\n" : "\n  ]\n");
+    out << "}\n";
+
+    str result = out.str();
+    writeFile(result, path);
+    return result;
+}
@@ -0,0 +1,134 @@
+//project fresa, 2017-2022
+//by jose pazos perez
+//licensed under GPLv3 uwu
+
+#pragma once
+
+#include "types.h"
+#include "scene.h"
+#include "jobs.h"
+#include "f_time.h"
+#include "histogram.h"
+
+#include <thread>
+#include <optional>
+
+//---Benchmark---
+//      Runs the physics loop on a synthetic scene with a fixed simulated clock, so it measures the engine and the physics systems without
+//      depending on the display or on the time of the machine. Each tick is exactly one physics iteration. The results (ticks per second,
+//      percentiles of the tick and of every system, and allocations) are returned as json and can be saved to a file
+//      Combined with the headless mode it can run on machines without a display, for example in a benchmark executable:
+//      int main() {
+//          Game::init(true);
+//          Benchmark::run({"particles", 10000, 100, [](Scene &s){
+//              for (int i = 0; i < 100000; i++)
+//                  s.addComponent<Component::Position>(s.createEntity());
+//          }}, "particles.json");
+//          Game::stop();
+//      }
+//      Allocations are only counted if the benchmark executable is compiled with FRESA_BENCHMARK_ALLOCATIONS, which replaces the global
+//      operator new, so it should not be defined for the game
+//      With an input recording (Input::startRecording) the benchmark replays a real session tick by tick, so the workload is the same
+
+namespace Fresa::Benchmark
+{
+    struct Options {
+        str name = "benchmark";
+        ui32 ticks = 1000;
+        ui32 warmup = 60; //: Ticks that run before measuring (caches, pools and the job threads)
+        std::function<void(Scene&)> setup = nullptr; //: Fills the scene
+        str replay = ""; //: Input recording to replay after the warmup, the benchmark runs for its length instead of the given ticks
+    };
+
+    //: Runs the benchmark in a new scene (which is the active scene while it runs) and returns the results as json
+    str run(const Options &options, str path = "");
+    
+    //---Command line---
+    //      Entry point for benchmark runs of the game executable, so automated runs don't need their own main. If the arguments have
+    //      --benchmark, --loading or --convert-scene it runs that (--benchmark initializes the game in headless mode), prints the json and
+    //      returns the exit status (0 if it finished, 1 if there was an error), otherwise it returns nothing and the game starts as usual:
+    //      int main(int argc, char** argv) {
+    //          if (auto status = Benchmark::command(argc, argv))
+    //              return *status;
+    //          ...
+    //      }
+    //      game --benchmark scene.fres [--ticks 1000] [--warmup 60] [--replay recording.rec] [--output results.json]
+    //      The scene is loaded from data/scenes/ (or the benchmark scene is empty if it is "-", to only measure the systems)
+    //      game --loading 50000 [--repeats 10] [--output results.json]
+    //      Times the text and binary loading (Benchmark::loading) of a scene from data/scenes/, or of a generated one with that many entities
+    //      game --convert-scene level.fres [other.fres ...]
+    //      Converts text scenes from data/scenes/ into binary ones next to them (level.fres.bin)
+    std::optional<int> command(int argc, char** argv);
+    
+    //---Loading---
+    //      Loads a text scene from data/scenes/ and its binary version (converted first and saved as file + ".bin") a number of times each,
+    //      and returns the load times and file sizes as json. The scene can be generated, loading(generateScene(50000)) compares both with 50k entities
+    str loading(str file, ui32 repeats = 10, str path = "");
+    
+    //: Writes data/scenes/benchmark_<entities>.fres, where every entity has all the components that the binary scenes can save (the
+    //      trivially copyable ones with number or vector members, with values taken from the entity index), and returns its name
+    str generateScene(ui32 entities);
+    
+    //---Component storage---
+    //      Compares the sparse set component pools with the dense layout they replaced, where every component type had a slot for each entity
+    //      index and iterating meant checking the mask of every entity. For each entity count a component of 16 bytes is added to one of
+    //      every stride entities, and it returns the memory of both layouts and the time to iterate over the components as json
+    str storage(std::vector<ui32> counts = {1000, 10000, 100000}, ui32 stride = 10, ui32 repeats = 100, str path = "");
+    
+    //---Entity churn---
+    //      Stress test for the entity recycling. It creates and removes entities at random (keeping at most max_live alive) for every recycle
+    //      policy, and checks after each operation that a removed id is never valid again, even after its slot is reused. It is an error if a
+    //      stale id is valid or if the entity list grows beyond the peak of live entities (plus the recycle delay, the indices held back)
+    //      Returns the time per operation and the counts of each policy as json
+    str churn(ui64 operations = 5000000, ui32 max_live = 10000, ui32 delay = 1024, str path = "");
+    
+    //---Event publish---
+    //      Measures the cost of publishing a LocalEvent<int> and an Event<int> with 0, 1, 10 and 100 observers, the time per publish in
+    //      nanoseconds and the allocations per publish (only counted with FRESA_BENCHMARK_ALLOCATIONS), returned as json
+    str events(ui32 publishes = 100000, str path = "");
+    
+    //---Parallel scaling---
+    //      Runs SceneView<C>::parallel_each over a scene with the given number of entities, first with one thread and then adding threads up
+    //      to max_threads (0 uses all the hardware threads), and returns the time of a pass and the speedup over one thread as json
+    //      It restarts the job system for each thread count, so it has to run before the game loop starts (like in the executable above):
+    //      Benchmark::scaling<Component::Transform>("movement", [](EntityID e, Component::Transform &t){ t.position += t.velocity; });
+    template <typename C, typename F>
+    str scaling(str name, F f, ui32 entities = 100000, ui32 passes = 100, ui32 max_threads = 0, str path = "");
+    
+    //: Results of the scaling benchmark, the pass times with 1, 2... threads
+    str scalingResults(const str &name, ui32 entities, ui32 passes, const std::vector<Histogram> &times, const str &path);
+    
+    template <typename C, typename F>
+    str scaling(str name, F f, ui32 entities, ui32 passes, ui32 max_threads, str path) {
+        Scene scene;
+        for (ui32 i = 0; i < entities; i++)
+            scene.addComponent<C>(scene.createEntity());
+        
+        ui32 previous_workers = Jobs::threadCount() - 1;
+        if (max_threads == 0)
+            max_threads = std::max(std::thread::hardware_concurrency(), 1u);
+        max_threads = std::min(max_threads, Jobs::max_threads - 1);
+        
+        std::vector<Histogram> times(max_threads);
+        for (ui32 threads = 1; threads <= max_threads; threads++) {
+            //: Without workers the jobs run on the calling thread
+            Jobs::stop();
+            if (threads > 1)
+                Jobs::init(threads - 1);
+            
+            SceneView<C> view(scene);
+            view.parallel_each(f); //: Warmup
+            for (ui32 i = 0; i < passes; i++) {
+                Clock::time_point before = time();
+                view.parallel_each(f);
+                times.at(threads - 1).add(ms(time() - before));
+            }
+        }
+        
+        Jobs::stop();
+        if (previous_workers > 0)
+            Jobs::init(previous_workers);
+        
+        return scalingResults(name, entities, passes, times, path);
+    }
+}
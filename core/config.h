@@ -16,6 +16,16 @@ namespace Fresa {
         static const float timestep;
         static float game_speed;
         
+        //: Timestep used by the game loop, the one above unless it is overriden (input replays lock it to the one they were recorded with)
+        inline static float timestep_override = 0.0f;
+        static float getTimestep() { return timestep_override > 0.0f ? timestep_override : timestep; }
+        
+        //: Maximum physics iterations in one frame, when the game can't keep up the extra time is dropped and it slows down instead
+        inline static ui32 max_substeps = 8;
+        
+        //: Runs the simulation of the next frame in another thread while the current one is rendered (render systems use renderScene())
+        inline static bool pipelined_render = false;
+        
         static str renderer_description_path;
         static bool draw_indirect;
         static ui8 multisampling;
@@ -3,58 +3,188 @@
 //licensed under GPLv3 uwu
 
 #include "f_time.h"
+#include "config.h"
+#include "log.h"
 
 using namespace Fresa;
 
+namespace {
+    //---Timer storage---
+    //      Timers live in a vector and are reused through a free list. The id has the index in the upper 32 bits and a version in the lower
+    //      32 bits, which changes every time the slot is freed, so old ids (for example a timer checked again after it finished) are ignored
+    struct TimerData {
+        ui64 deadline = 0; //: In ms of the timer scale
+        ui32 version = 0;
+        bool active = false;
+        TimerScale scale = TIMER_GAME;
+        std::function<void()> callback;
+    };
+    std::vector<TimerData> timers{};
+    std::vector<ui32> free_timers{};
+
+    TimerID createID(ui32 index, ui32 version) { return ((TimerID)index << 32) | version; }
+    ui32 getIndex(TimerID id) { return (ui32)(id >> 32); }
+    ui32 getVersion(TimerID id) { return (ui32)id; }
+
+    TimerData* getTimer(TimerID id) {
+        ui32 index = getIndex(id);
+        if (index >= timers.size() or not timers[index].active or timers[index].version != getVersion(id))
+            return nullptr;
+        return &timers[index];
+    }
+
+    void freeTimer(ui32 index) {
+        timers[index].active = false;
+        timers[index].callback = nullptr;
+        timers[index].version++;
+        free_timers.push_back(index);
+    }
+
+    //---Timing wheel---
+    //      Hierarchical wheel for the callback timers, with a tick of 1ms. Each level has 64 slots and covers 64 times the range of the previous
+    //      one, timers are placed in the first level that can hold their deadline. When the lower level wraps around, the next slot of the
+    //      upper level is moved down (cascaded), so each timer is touched at most once per level and expiring is O(1) amortized
+    //      Timers further away than the last level wait in an overflow list that is checked when the last level wraps
+    //      Cancelled timers are not searched for, they are skipped when their slot expires because the id no longer matches
+    struct TimingWheel {
+        static constexpr ui32 levels = 4;
+        static constexpr ui32 slot_bits = 6;
+        static constexpr ui32 slot_count = 1 << slot_bits;
+        static constexpr ui64 slot_mask = slot_count - 1;
+
+        std::array<std::array<std::vector<TimerID>, slot_count>, levels> slots{};
+        std::vector<TimerID> overflow{};
+        ui64 now = 0;
+
+        void insert(TimerID id, ui64 deadline) {
+            //: Deadlines that already passed expire in the current slot (when cascading) or the next one
+            deadline = std::max(deadline, now);
+            ui64 delta = deadline - now;
+            for (ui32 level = 0; level < levels; level++) {
+                if (delta < (1ull << (slot_bits * (level + 1)))) {
+                    slots[level][(deadline >> (slot_bits * level)) & slot_mask].push_back(id);
+                    return;
+                }
+            }
+            overflow.push_back(id);
+        }
+
+        void cascade(ui32 level) {
+            std::vector<TimerID> list = std::move(slots[level][(now >> (slot_bits * level)) & slot_mask]);
+            slots[level][(now >> (slot_bits * level)) & slot_mask].clear();
+            for (TimerID id : list)
+                if (TimerData* t = getTimer(id))
+                    insert(id, t->deadline);
+        }
+
+        void advance(ui64 to) {
+            while (now < to) {
+                now++;
+
+                //: Cascade the upper levels when the lower ones wrap around, from the top down
+                ui32 wrapped = 0;
+                while (wrapped < levels - 1 and ((now >> (slot_bits * (wrapped + 1))) << (slot_bits * (wrapped + 1))) == now)
+                    wrapped++;
+                if (wrapped == levels - 1 and ((now >> (slot_bits * levels)) << (slot_bits * levels)) == now) {
+                    std::vector<TimerID> list = std::move(overflow);
+                    overflow.clear();
+                    for (TimerID id : list)
+                        if (TimerData* t = getTimer(id))
+                            insert(id, t->deadline);
+                }
+                for (ui32 level = wrapped; level > 0; level--)
+                    cascade(level);
+
+                //: Expire the current slot (callbacks can add new timers, so the list is moved out first)
+                std::vector<TimerID> list = std::move(slots[0][now & slot_mask]);
+                slots[0][now & slot_mask].clear();
+                for (TimerID id : list) {
+                    TimerData* t = getTimer(id);
+                    if (t == nullptr)
+                        continue;
+                    std::function<void()> callback = std::move(t->callback);
+                    freeTimer(getIndex(id));
+                    callback();
+                }
+            }
+        }
+    };
+    std::array<TimingWheel, 2> wheels{};
+
+    ui64 nowFor(TimerScale scale) {
+        return (ui64)(scale == TIMER_GAME ? Time::game_time : Time::real_time);
+    }
+
+    TimerID addTimer(ui32 ms, TimerScale scale, std::function<void()> callback) {
+        ui32 index;
+        if (not free_timers.empty()) {
+            index = free_timers.back();
+            free_timers.pop_back();
+        } else {
+            index = (ui32)timers.size();
+            timers.push_back(TimerData{});
+        }
+
+        TimerData &t = timers[index];
+        t.deadline = nowFor(scale) + ms;
+        t.active = true;
+        t.scale = scale;
+        t.callback = std::move(callback);
+        return createID(index, t.version);
+    }
+}
+
 Clock::time_point Fresa::time() {
     //---The actual time ^·^---
     return Clock::now();
 }
 
-TimerID Fresa::setTimer(ui32 ms) {
+TimerID Fresa::setTimer(ui32 ms, TimerScale scale) {
     //---Set timer---
-    //      Creates a new timer and appends it to the timer list, saves the duration and start time
-    static TimerID timer_id = 0;
-    do timer_id++;
-        while (Time::timers.find(timer_id) != Time::timers.end());
-    
-    Time::timers[timer_id] = Timer(std::chrono::milliseconds(ms), time());
-    
-    return timer_id;
+    //      Creates a new timer that finishes after the duration, in game or real time
+    return addTimer(ms, scale, nullptr);
 }
 
-bool Fresa::checkTimer(TimerID timer, float game_speed) {
+bool Fresa::checkTimer(TimerID timer) {
     //---Check timer---
     //      Returns true when the timer is finished, and then removes it from the list
     //      It will return false if the timer is not registered (For example, when it is called multiple times after a timer is finished)
-    if (Time::timers.find(timer) == Time::timers.end())
+    TimerData* t = getTimer(timer);
+    if (t == nullptr or t->callback != nullptr)
         return false;
-    
-    Clock::time_point current = time();
-    Duration delta = current - Time::timers[timer].start;
-    
-    bool done = delta >= Time::timers[timer].duration;
+
+    bool done = nowFor(t->scale) >= t->deadline;
     if (done)
-        Time::timers.erase(timer);
-    
+        freeTimer(getIndex(timer));
+
     return done;
 }
 
 Duration Fresa::getTimerRemainder(TimerID timer) {
     //---Timer remainder---
-    //      Returns the time for the timer to finish
-    if (Time::timers.find(timer) == Time::timers.end())
+    //      Returns the time for the timer to finish (in the timer scale, so game timers take longer if the game is slowed down)
+    TimerData* t = getTimer(timer);
+    if (t == nullptr)
         return Duration(0);
-    
-    Clock::time_point current = time();
-    Duration delta = current - Time::timers[timer].start;
-    
-    return Time::timers[timer].duration - delta;
+
+    return std::chrono::milliseconds((std::int64_t)t->deadline - (std::int64_t)nowFor(t->scale));
 }
 
 void Fresa::stopTimer(TimerID timer) {
     //---Unregister timer---
-    Time::timers.erase(timer);
+    //      Callback timers stay in the wheel, but they are skipped since the id is no longer valid
+    if (getTimer(timer) != nullptr)
+        freeTimer(getIndex(timer));
+}
+
+TimerID Fresa::callbackTimer(ui32 ms, std::function<void()> callback, TimerScale scale) {
+    if (callback == nullptr)
+        log::error("Callback timers need a function");
+    TimerID id = addTimer(ms, scale, std::move(callback));
+    
+    //: The current slot of the wheel was already expired, so the earliest it can finish is the next tick
+    wheels[scale].insert(id, std::max(getTimer(id)->deadline, wheels[scale].now + 1));
+    return id;
 }
 
 double Fresa::ns(Duration duration) {
@@ -72,14 +202,15 @@ double Fresa::sec(Duration duration) {
     return duration.count() * 1.0e-9;
 }
 
-void Time::updateCallbackTimers() {
-    std::vector<TimerID> to_erase{};
-    for (auto &[timer, callback] : callback_timers) {
-        if (checkTimer(timer)) {
-            callback();
-            to_erase.push_back(timer);
-        }
+void Time::updateTimers() {
+    //---Update timers---
+    //      Uses the time points of this frame, the first frame (without a previous time point) doesn't advance the clocks
+    if (previous != Clock::time_point{}) {
+        double delta = Fresa::ms(current - previous);
+        real_time += delta;
+        game_time += delta * Config::game_speed;
     }
-    for (auto &timer : to_erase) //: In order to avoid problems with the previous for
-        callback_timers.erase(timer);
+
+    wheels[TIMER_REAL].advance((ui64)real_time);
+    wheels[TIMER_GAME].advance((ui64)game_time);
 }
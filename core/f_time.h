@@ -6,20 +6,19 @@
 
 #include "types.h"
 #include "events.h"
+#include "profiler.h"
 #include <chrono>
 
 namespace Fresa
 {
     using Clock = std::chrono::steady_clock;
     using Duration = std::chrono::nanoseconds;
-    using TimerID = ui32;
-
-    struct Timer {
-        Clock::time_point start;
-        Duration duration;
-        
-        Timer() = default;
-        Timer(Duration p_d, Clock::time_point p_s) : duration(p_d), start(p_s) {};
+    using TimerID = ui64;
+    
+    //: Timers can run on game time (scaled by Config::game_speed, stopped when it is 0) or on real time (for things like the gui)
+    enum TimerScale {
+        TIMER_GAME,
+        TIMER_REAL,
     };
     
     namespace Time {
@@ -35,18 +34,29 @@ namespace Fresa
         inline double physics_delta = 0.0;
         inline double accumulator = 0.0;
         
-        //---Timer list---
-        inline std::map<TimerID, Timer> timers{};
+        //: Number of physics iterations since the start
+        inline ui64 physics_tick = 0;
+        
+        //: Interpolation between the last physics tick and the next one (accumulator / timestep, from 0 to 1), for render systems
+        inline double alpha = 0.0;
+        
+        //: Physics tick that the render shows (in the pipelined mode the simulation can already be running the next one)
+        inline ui64 render_tick = 0;
+        
+        //---Timer clocks---
+        //      Milliseconds of game and real time since the start, advanced once per frame from the current and previous time points, so
+        //      the clock is only read once per frame and timers have the resolution of a frame
+        inline double game_time = 0.0;
+        inline double real_time = 0.0;
         
-        //---Callback timers---
-        inline std::map<TimerID, std::function<void()>> callback_timers{};
-        void updateCallbackTimers();
+        //: Advances the timer clocks and calls the callback timers that expired
+        void updateTimers();
     }
 
     Clock::time_point time();
     
-    TimerID setTimer(ui32 ms);
-    bool checkTimer(TimerID timer, float game_speed = 1.0f);
+    TimerID setTimer(ui32 ms, TimerScale scale = TIMER_GAME);
+    bool checkTimer(TimerID timer);
     Duration getTimerRemainder(TimerID timer);
     void stopTimer(TimerID timer);
 
@@ -54,35 +64,33 @@ namespace Fresa
     double ms(Duration duration);
     double sec(Duration duration);
     
+    //---Timed call---
+    //      Calls the function inside a profiler zone with the given name and saves the duration in milliseconds
     template <typename Callable, typename... Args>
-    auto TIME(double &call_time, Callable &f, const Args&... a) {
+    auto TIME(double &call_time, std::string_view name, Callable &f, const Args&... a) {
         constexpr bool is_void = std::is_same_v<decltype(f(a...)), void> == true;
-        #ifdef DEBUG
-        Clock::time_point time_before_call = time();
+        Profiler::Zone zone(name);
         if constexpr (is_void) {
             f(a...);
-            call_time = ms(time() - time_before_call);
+            call_time = zone.ms();
         } else {
             auto v = f(a...);
-            call_time = ms(time() - time_before_call);
+            call_time = zone.ms();
             return v;
         }
-        #else
-        if constexpr (is_void)
-            f(a...);
-        else
-            return f(a...);
-        #endif
     }
     
-    inline void callbackTimer(ui32 ms, std::function<void()> callback) {
-        TimerID t = setTimer(ms);
-        Time::callback_timers[t] = callback;
+    //: Calls the function once the timer finishes (it can be cancelled with stopTimer)
+    TimerID callbackTimer(ui32 ms, std::function<void()> callback, TimerScale scale = TIMER_GAME);
+    
+    template <typename... Args>
+    TimerID eventTimer(ui32 ms, Event::Event<Args...> &e, const Args&... a) {
+        return callbackTimer(ms, [&e, a...](){ e.publish(a...); });
     }
     
     template <typename... Args>
-    void eventTimer(ui32 ms, Event::Event<Args...> &e, const Args&... a) {
-        callbackTimer(ms, [&](){ e.publish(a...); });
+    TimerID eventTimer(ui32 ms, Event::LocalEvent<Args...> &e, const Args&... a) {
+        return callbackTimer(ms, [&e, a...](){ e.publish(a...); });
     }
     
     namespace Performance {
@@ -102,6 +110,20 @@ namespace Fresa
         //: One event handling iteration inside the physics time
         inline double physics_event_time = 0.0;
         
+        //: Timings of every iteration of the last physics frame, since the values above only keep the last one (the samples are reused
+        //  between frames, only the first physics_sample_count are valid). The event time is negative if the events weren't handled in it
+        //  The simulation thread writes them in the pipelined mode, so they can only be read from event_sync, like the performance window
+        struct PhysicsSample {
+            double iteration;
+            double event;
+            std::vector<double> systems;
+        };
+        inline std::vector<PhysicsSample> physics_samples{};
+        inline size_t physics_sample_count = 0;
+        
+        //: Physics iterations skipped because a frame needed more than Config::max_substeps
+        inline ui64 physics_dropped_steps = 0;
+        
         //: Render frame time (The time of the entire rendering call, including vsync)
         inline double render_frame_time = 0.0;
         
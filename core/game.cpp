@@ -7,15 +7,24 @@
 #include "log.h"
 
 #include "input.h"
+#include "input_recorder.h"
+#include "input_actions.h"
 #include "file.h"
 #include "audio.h"
 #include "events.h"
+#include "event_queue.h"
 #include "scene.h"
+#include "scheduler.h"
+#include "jobs.h"
+#include "task.h"
 #include "f_time.h"
 
 #include "r_graphics.h"
 
 #include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cmath>
 
 using namespace Fresa;
 
@@ -24,9 +33,96 @@ namespace {
     Event::Observer pausedObserver = Event::event_paused.createObserver([](const bool paused){ is_paused = paused; });
     bool is_quitting = false;
     Event::Observer quitObserver = Event::event_quit.createObserver([](){ is_quitting = true; });
+    bool is_headless = false;
+    bool is_pipelined = false;
+    
+    //---Simulation thread---
+    //      In the pipelined mode the simulation runs in its own thread while the main thread renders the previous frame. The main thread hands
+    //      it one frame at a time and waits for it to finish before starting the next one, so there is never more than one frame in flight
+    struct Simulation {
+        std::thread thread;
+        std::mutex mutex;
+        std::condition_variable condition;
+        bool requested = false;
+        bool finished = true;
+        bool exit = false;
+        bool result = true;
+    };
+    Simulation simulation{};
+    
+    void simulationLoop() {
+        Jobs::attachThread();
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(simulation.mutex);
+                simulation.condition.wait(lock, [](){ return simulation.requested or simulation.exit; });
+                if (simulation.exit)
+                    return;
+                simulation.requested = false;
+            }
+            
+            bool result = TIME(Performance::physics_frame_time, "physics", Game::physicsUpdate);
+            
+            {
+                std::lock_guard<std::mutex> lock(simulation.mutex);
+                simulation.result = result;
+                simulation.finished = true;
+            }
+            simulation.condition.notify_all();
+        }
+    }
+    
+    void startSimulation() {
+        if (not simulation.thread.joinable())
+            simulation.thread = std::thread(simulationLoop);
+        {
+            std::lock_guard<std::mutex> lock(simulation.mutex);
+            simulation.finished = false;
+            simulation.requested = true;
+        }
+        simulation.condition.notify_all();
+    }
+    
+    bool waitSimulation() {
+        std::unique_lock<std::mutex> lock(simulation.mutex);
+        simulation.condition.wait(lock, [](){ return simulation.finished; });
+        return simulation.result;
+    }
+    
+    void stopSimulation() {
+        if (not simulation.thread.joinable())
+            return;
+        waitSimulation();
+        {
+            std::lock_guard<std::mutex> lock(simulation.mutex);
+            simulation.exit = true;
+        }
+        simulation.condition.notify_all();
+        simulation.thread.join();
+    }
+    
+    Signature renderSignature() {
+        //: Components that the render systems read or write, all of them if a system doesn't declare its access
+        Signature signature;
+        for (auto &[priority, system] : System::render_update_systems) {
+            if (system.access.exclusive)
+                return Signature().set();
+            signature |= system.access.reads | system.access.writes;
+        }
+        return signature;
+    }
+    
+    void syncRender() {
+        //: Interpolation for the render systems
+        Time::alpha = std::min(Time::accumulator / (Config::getTimestep() * 1.0e6), 1.0);
+        Time::render_tick = Time::physics_tick;
+        
+        //: The simulation is not running, the render can read its state
+        Event::event_sync.publish();
+    }
 }
 
-bool Game::init() {
+bool Game::init(bool headless) {
     //---Game setup---
     log::debug("Starting the game...");
     
@@ -37,30 +133,47 @@ bool Game::init() {
     SDL_version version;
     SDL_GetVersion(&version);
     log::debug("SDL v%d.%d.%d", version.major, version.minor, version.patch);
-    if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO | SDL_INIT_EVENTS) != 0) {
+    is_headless = headless;
+    if (SDL_Init(is_headless ? SDL_INIT_EVENTS : SDL_INIT_VIDEO | SDL_INIT_AUDIO | SDL_INIT_EVENTS) != 0) {
         log::error("SDL_Init has failed!!", SDL_GetError());
         return false;
     }
     
     //: Graphics
-    if (not Graphics::init())
+    if (not is_headless and not Graphics::init())
         return false;
     
     //: Input
     Input::init();
     
     //: Audio
-    Audio::init();
+    if (not is_headless)
+        Audio::init();
+    
+    //: Jobs
+    Jobs::init();
     
     //: System init
     for (auto &[priority, system] : System::init_systems)
-        system.second();
+        system.update();
     
     return true;
 }
 
 bool Game::update() {
     //---Game update---
+    //      Physics and then render on the same thread. In the pipelined mode (Config::pipelined_render) the simulation of the next frame runs
+    //      in a separate thread while this one renders a snapshot of the frame that just finished. The snapshot has the components that
+    //      the render systems declare, and they read it using renderScene(). The system events, scene transitions and timers are handled
+    //      here while the simulation is stopped. Render systems shouldn't touch other simulation state (like timers or events) in this mode
+    //      Only the scene is copied for the render. The rest of the state that the simulation writes (Input::keyboard, Input::mouse, the
+    //      action states, the physics samples of Performance and the tasks) is only safe to read from the main thread between
+    //      waitSimulation() and startSimulation(), which is when event_sync is published
+    
+    //: Wait for the simulation of the previous frame (pipelined mode)
+    if (not waitSimulation())
+        return false;
+    is_pipelined = Config::pipelined_render and not is_headless;
     
     //: Check if paused
     while (is_paused) {
@@ -69,18 +182,54 @@ bool Game::update() {
         if (is_quitting) return false;
     }
     
+    //: Profiler frame marker
+    Profiler::frame();
+    
+    //: Events and messages queued from other threads
+    Event::drainQueues();
+    
+    //: Scene transition, swap the scene loaded in the background
+    swapQueuedScene();
+    
     //: Check scene
-    if (not scene_list.count(active_scene)) {
+    if (not scene_list.contains(active_scene)) {
         log::error("Scene not defined!");
         return false;
     }
     
+    //: Pipelined update
+    if (is_pipelined) {
+        //: Events for the next simulation frame
+        TIME(Performance::physics_event_time, "events", Event::handleSystemEvents);
+        if (is_quitting) return false;
+        
+        //: Snapshot for the render
+        if (render_snapshot == nullptr)
+            render_snapshot = std::make_unique<Scene>();
+        {
+            PROFILE("snapshot");
+            render_snapshot->copyFrom(scene_list.at(active_scene), renderSignature());
+        }
+        syncRender();
+        
+        //: Advance time and simulate the next frame
+        timeFrame();
+        startSimulation();
+        
+        //: Render update
+        TIME(Performance::render_frame_time, "render", Graphics::update);
+        return true;
+    }
+    render_snapshot.reset();
+    
     //: Physics update
-    if (not TIME(Performance::physics_frame_time, physicsUpdate))
+    if (not TIME(Performance::physics_frame_time, "physics", physicsUpdate))
         return false;
+    syncRender();
    
     //: Render update
-    TIME(Performance::render_frame_time, Graphics::update);
+    if (not is_headless)
+        TIME(Performance::render_frame_time, "render", Graphics::update);
     
     //: Advance time
     timeFrame();
@@ -94,29 +243,67 @@ bool Game::physicsUpdate() {
     //      This is achieved using an accumulator that will get filled with the time passed each frame, and then time will be discounted from it
     //      in regular intervals, updating the physics then. We can use that to calculate the delta time.
     //      (for reference check https://gafferongames.com/post/fix_your_timestep/)
+    //      The number of iterations per frame is limited by Config::max_substeps. If a frame is so slow that it would need more, the rest of
+    //      the accumulated time is dropped, so the game slows down instead of falling further behind each frame (the spiral of death)
+    
+    double step = Config::getTimestep() * 1.0e6; //: In nanoseconds
+    ui32 substeps = 0;
+    Performance::physics_sample_count = 0;
     
-    while (Time::accumulator >= Config::timestep * 1.0e6) {
-        Clock::time_point time_before_physics_iteration = time();
+    while (Time::accumulator >= step) {
+        //: Catch up budget
+        if (substeps++ >= Config::max_substeps) {
+            double dropped = std::floor(Time::accumulator / step);
+            Performance::physics_dropped_steps += (ui64)dropped;
+            Time::accumulator -= dropped * step;
+            break;
+        }
+        
+        Profiler::Zone iteration("physics iteration");
         
         //: Timestep
-        Time::accumulator -= Config::timestep * 1.0e6; //: In nanoseconds
-        Time::physics_delta = Config::timestep * 1.0e-3 * Config::game_speed; //: In seconds
+        Time::accumulator -= step;
+        Time::physics_delta = Config::getTimestep() * 1.0e-3 * Config::game_speed; //: In seconds
+        Time::physics_tick++;
         
-        //: Events
-        TIME(Performance::physics_event_time, Event::handleSystemEvents);
+        //: Events (in the pipelined mode they are handled by the main thread before the simulation starts)
+        if (not is_pipelined)
+            TIME(Performance::physics_event_time, "events", Event::handleSystemEvents);
         if (is_quitting) return false;
         
-        //: Input
+        //: Input (a replay adds the recorded events of this tick, and a recording saves them)
+        Input::replayFrame();
         Input::frame();
+        Input::recordFrame();
+        Input::actions.update();
+        
+        //: Change detection tick
+        scene_list.at(active_scene).advanceTick();
         
         //: Systems
-        Performance::physics_system_time.clear();
-        for (auto &[priority, system] : System::physics_update_systems) {
-            Performance::physics_system_time.push_back(0);
-            TIME(Performance::physics_system_time.back(), system.second);
+        System::run(System::physics_update_systems, Performance::physics_system_time);
+        
+        //: Structural changes recorded during the systems
+        {
+            PROFILE("commands");
+            scene_list.at(active_scene).playbackCommands();
+        }
+        
+        //: Tasks
+        {
+            PROFILE("tasks");
+            Tasks::update();
         }
         
-        Performance::physics_iteration_time = ms(time() - time_before_physics_iteration);
+        Performance::physics_iteration_time = iteration.ms();
+        
+        //: Sample of this iteration
+        if (Performance::physics_samples.size() <= Performance::physics_sample_count)
+            Performance::physics_samples.emplace_back();
+        auto &sample = Performance::physics_samples.at(Performance::physics_sample_count++);
+        sample.iteration = Performance::physics_iteration_time;
+        sample.event = is_pipelined ? -1.0 : Performance::physics_event_time;
+        sample.systems = Performance::physics_system_time;
     }
     
     return true;
@@ -140,21 +327,27 @@ void Game::timeFrame() {
     //Time::next = Time::current + fps_limit;
     //fps_limit = round<Clock::duration>(std::chrono::duration<double>{1./60.});
     
-    //: Add to accumulator
+    //: Add to accumulator (physicsUpdate limits how much of it is used each frame)
     Time::accumulator += ns(Time::current - Time::previous);
     
-    //: Prevent too many physics updates to pile up (10 seconds)
-    if (Time::accumulator > 1.0e10)
-        Time::accumulator = 0.0;
-    
-    //: Update callback timers
-    Time::updateCallbackTimers();
+    //: Update timers
+    Time::updateTimers();
 }
 
 void Game::stop() {
     //---Clean resources---
     log::debug("Closing the game...");
     
-    Graphics::stop();
+    stopSimulation();
+    Input::stopRecording();
+    render_snapshot.reset();
+    Tasks::clear();
+    Jobs::stop();
+    if (not is_headless)
+        Graphics::stop();
     SDL_Quit();
 }
+
+bool Game::isHeadless() {
+    return is_headless;
+}
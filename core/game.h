@@ -10,7 +10,9 @@
 
 namespace Fresa::Game
 {
-    bool init();
+    //: Headless mode doesn't create a window, graphics or audio, only the simulation runs (for benchmarks and servers)
+    bool init(bool headless = false);
+    bool isHeadless();
 
     bool update();
     bool physicsUpdate();
@@ -0,0 +1,62 @@
+//project fresa, 2017-2022
+//by jose pazos perez
+//licensed under GPLv3 uwu
+
+#pragma once
+
+#include "types.h"
+#include "f_time.h"
+
+//---Interpolated---
+//      Value that keeps its state of the previous and the current physics tick, so render systems can draw it between them using the
+//      interpolation alpha (how far the real time is between the last physics tick and the next one). This way the physics can run at a
+//      low fixed rate (for example 30Hz) while the rendering stays smooth at the refresh rate of the display
+//      struct Body {
+//          Members(Body, position)
+//          Interpolated<Vec2<float>> position;
+//      };
+//      body->position.set(body->position.get() + velocity * Time::physics_delta); //: Physics system
+//      Vec2<float> pos = body->position.interpolate(); //: Render system, uses Time::alpha
+//      The previous value is saved on the first set of each tick, so values that are not updated in a tick just stay still. Use teleport
+//      for jumps that shouldn't be interpolated. T needs + and - between values and * with a float (numbers, Vec2, glm vectors...)
+
+namespace Fresa
+{
+    template <typename T>
+    struct Interpolated {
+        Interpolated() = default;
+        Interpolated(const T &value) : previous(value), current(value) {}
+
+        //: Physics, update the value
+        void set(const T &value) {
+            if (tick != Time::physics_tick) {
+                previous = current;
+                tick = Time::physics_tick;
+            }
+            current = value;
+        }
+
+        //: Physics, move without interpolating
+        void teleport(const T &value) {
+            previous = value;
+            current = value;
+            tick = Time::physics_tick;
+        }
+
+        const T &get() const { return current; }
+
+        //: Render, value between the previous and the current tick
+        T interpolate(double alpha = Time::alpha) const {
+            if (tick != Time::render_tick)
+                return current;
+            if constexpr (std::is_arithmetic_v<T>)
+                return (T)(previous + (current - previous) * alpha);
+            else
+                return previous + (current - previous) * (float)alpha;
+        }
+
+        T previous{};
+        T current{};
+        ui64 tick = 0;
+    };
+}
@@ -0,0 +1,156 @@
+//project fresa, 2017-2022
+//by jose pazos perez
+//licensed under GPLv3 uwu
+
+#include "jobs.h"
+
+#include <thread>
+#include <mutex>
+#include <deque>
+#include <condition_variable>
+
+using namespace Fresa;
+
+namespace {
+    struct Task {
+        Jobs::Job job;
+        Jobs::Counter* counter;
+    };
+
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues{};
+    std::vector<std::thread> workers{};
+
+    std::atomic<ui32> queued = 0;
+    std::atomic<bool> running = false;
+    std::mutex sleep_mutex;
+    std::condition_variable sleep_condition;
+
+    thread_local ui32 thread_index = 0;
+    thread_local bool is_worker = false;
+
+    bool pop(ui32 index, Task &task) {
+        //: Own queue, last in first out (the most recent job is more likely to be in cache)
+        Queue &queue = *queues.at(index);
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.tasks.empty())
+            return false;
+        task = std::move(queue.tasks.back());
+        queue.tasks.pop_back();
+        return true;
+    }
+
+    bool steal(ui32 index, Task &task) {
+        //: Other queues, first in first out (take the oldest jobs, usually the biggest ones)
+        for (ui32 i = 1; i < queues.size(); i++) {
+            Queue &queue = *queues.at((index + i) % queues.size());
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (queue.tasks.empty())
+                continue;
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+            return true;
+        }
+        return false;
+    }
+
+    bool runOne(ui32 index) {
+        Task task;
+        if (not pop(index, task) and not steal(index, task))
+            return false;
+        queued--;
+        task.job();
+        task.counter->pending.fetch_sub(1, std::memory_order_acq_rel);
+        return true;
+    }
+
+    void workerLoop(ui32 index) {
+        thread_index = index;
+        is_worker = true;
+        while (running) {
+            if (runOne(index))
+                continue;
+            std::unique_lock<std::mutex> lock(sleep_mutex);
+            sleep_condition.wait(lock, [](){ return queued > 0 or not running; });
+        }
+    }
+}
+
+void Jobs::init(ui32 worker_count) {
+    if (running)
+        return;
+
+    if (worker_count == 0) {
+        ui32 hardware = std::thread::hardware_concurrency();
+        worker_count = hardware > 1 ? hardware - 1 : 0;
+    }
+    worker_count = std::min(worker_count, max_threads - 2);
+
+    //: One queue for the main thread, one for each worker and one for the attached thread
+    running = true;
+    for (ui32 i = 0; i < worker_count + 2; i++)
+        queues.push_back(std::make_unique<Queue>());
+    for (ui32 i = 1; i < worker_count + 1; i++)
+        workers.emplace_back(workerLoop, i);
+}
+
+void Jobs::stop() {
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        running = false;
+    }
+    sleep_condition.notify_all();
+
+    for (auto &w : workers)
+        w.join();
+    workers.clear();
+    queues.clear();
+}
+
+void Jobs::submit(Counter &counter, Job job) {
+    //: Without workers the job is executed right away
+    if (not running or workers.empty()) {
+        job();
+        return;
+    }
+
+    counter.pending.fetch_add(1, std::memory_order_relaxed);
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        queued++;
+    }
+    {
+        Queue &queue = *queues.at(thread_index);
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks.push_back(Task{std::move(job), &counter});
+    }
+    sleep_condition.notify_one();
+}
+
+void Jobs::wait(Counter &counter) {
+    //: Help with the pending work until this group is done
+    while (counter.pending.load(std::memory_order_acquire) > 0) {
+        if (not runOne(thread_index))
+            std::this_thread::yield();
+    }
+}
+
+ui32 Jobs::threadCount() {
+    return (ui32)workers.size() + 1;
+}
+
+ui32 Jobs::threadIndex() {
+    return thread_index;
+}
+
+bool Jobs::isWorker() {
+    return is_worker;
+}
+
+void Jobs::attachThread() {
+    thread_index = (ui32)workers.size() + 1;
+}
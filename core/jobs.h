@@ -0,0 +1,49 @@
+//project fresa, 2017-2022
+//by jose pazos perez
+//licensed under GPLv3 uwu
+
+#pragma once
+
+#include "types.h"
+#include <atomic>
+
+//---Jobs---
+//      Work stealing thread pool. Each thread has its own queue of jobs, it takes work from the back of its queue and, when it runs out,
+//      it steals from the front of the queues of the other threads. Jobs are grouped using a counter, and the thread that waits for a group
+//      keeps executing jobs instead of blocking, so the main thread also takes part in the work
+//      Jobs::Counter counter;
+//      Jobs::submit(counter, [](){ ... });
+//      Jobs::wait(counter);
+
+namespace Fresa::Jobs
+{
+    using Job = std::function<void()>;
+
+    //: Number of pending jobs of a group
+    struct Counter {
+        std::atomic<ui32> pending = 0;
+    };
+
+    //: Maximum number of threads (workers and the main thread), so per thread data can be allocated up front
+    constexpr ui32 max_threads = 64;
+
+    //: Starts the worker threads (by default, one less than the hardware threads, since the main thread also works)
+    void init(ui32 worker_count = 0);
+    void stop();
+
+    void submit(Counter &counter, Job job);
+    void wait(Counter &counter);
+
+    //: Number of threads that execute jobs (workers and the main thread)
+    ui32 threadCount();
+
+    //: Index of the current thread, 0 for the main thread (or any thread that is not a worker) and 1...n for the workers
+    ui32 threadIndex();
+
+    //: True on the worker threads (jobs can also run on the thread that waits for them)
+    bool isWorker();
+
+    //: Gives the calling thread its own queue and index (n + 1), so it can submit and wait for jobs at the same time as the main thread
+    //      without sharing per thread data with it. Only one thread can be attached (the simulation thread of the pipelined mode)
+    void attachThread();
+}
@@ -0,0 +1,262 @@
+//project fresa, 2017-2022
+//by jose pazos perez
+//licensed under GPLv3 uwu
+
+#include "profiler.h"
+#include "jobs.h"
+#include "log.h"
+
+#include <fstream>
+
+using namespace Fresa;
+using namespace Fresa::Profiler;
+
+namespace {
+    //---Thread buffers---
+    //      Each thread that records a zone gets a ring buffer the first time. Only that thread writes to it, and the write position is
+    //      published with release semantics, so the capture (on the main thread) can read the finished zones without locking. When the ring
+    //      is full the oldest zones are overwritten. Buffers of threads that exit are reused by new threads
+    struct ZoneData {
+        std::string_view name;
+        Ticks start;
+        Ticks end;
+        ui32 depth;
+    };
+
+    constexpr ui64 buffer_size = 1 << 15;
+    constexpr ui64 buffer_mask = buffer_size - 1;
+
+    struct ThreadBuffer {
+        std::unique_ptr<ZoneData[]> zones = std::make_unique<ZoneData[]>(buffer_size);
+        std::atomic<ui64> write = 0;
+        std::atomic<bool> in_use = true;
+        ui32 slot = 0;
+        ui32 job_index = 0;
+    };
+
+    struct BufferList {
+        std::array<std::atomic<ThreadBuffer*>, Jobs::max_threads> list{};
+        std::atomic<ui32> count = 0;
+        ~BufferList() {
+            for (auto &b : list)
+                delete b.load();
+        }
+    };
+    BufferList buffers{};
+
+    struct LocalBuffer {
+        ThreadBuffer* buffer = nullptr;
+        bool registered = false;
+        ~LocalBuffer() {
+            if (buffer != nullptr)
+                buffer->in_use.store(false, std::memory_order_release);
+        }
+    };
+    thread_local LocalBuffer local{};
+
+    ThreadBuffer* registerThread() {
+        local.registered = true;
+
+        //: Reuse the buffer of a thread that finished
+        ui32 count = std::min(buffers.count.load(std::memory_order_acquire), Jobs::max_threads);
+        for (ui32 i = 0; i < count; i++) {
+            ThreadBuffer* b = buffers.list[i].load(std::memory_order_acquire);
+            bool free = false;
+            if (b != nullptr and b->in_use.compare_exchange_strong(free, true, std::memory_order_acq_rel)) {
+                b->job_index = Jobs::threadIndex();
+                local.buffer = b;
+                return b;
+            }
+        }
+
+        //: New buffer, if there are too many threads the zones of this one are ignored
+        ui32 slot = buffers.count.fetch_add(1, std::memory_order_acq_rel);
+        if (slot >= Jobs::max_threads)
+            return nullptr;
+        ThreadBuffer* b = new ThreadBuffer();
+        b->slot = slot;
+        b->job_index = Jobs::threadIndex();
+        buffers.list[slot].store(b, std::memory_order_release);
+        local.buffer = b;
+        return b;
+    }
+
+    ThreadBuffer* localBuffer() {
+        if (not local.registered)
+            return registerThread();
+        return local.buffer;
+    }
+
+    //---Frames---
+    //      Start timestamp of the last frames, the end of a frame is the start of the next one
+    constexpr ui64 frame_history = 1024;
+    std::array<Ticks, frame_history> frame_starts{};
+    ui64 current_frame = 0;
+    ui32 main_slot = 0;
+
+    struct Capture {
+        str path;
+        ui64 first;
+        ui64 last;
+    };
+    std::vector<Capture> captures{};
+
+    //---Calibration---
+    //      The cpu counter runs at a fixed rate, but it is unknown. A first estimate is measured against steady_clock the first time it is
+    //      needed, and then every frame it is refined using the time since the first frame
+    #ifdef PROFILER_RDTSC
+    using SteadyClock = std::chrono::steady_clock;
+    std::atomic<double> ns_per_tick = 0.0;
+    Ticks base_ticks = 0;
+    SteadyClock::time_point base_time{};
+
+    double initialRate() {
+        static double rate = [](){
+            SteadyClock::time_point t = SteadyClock::now();
+            Ticks c = now();
+            while (SteadyClock::now() - t < std::chrono::milliseconds(1)) {}
+            double elapsed = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(SteadyClock::now() - t).count();
+            return elapsed / (double)(now() - c);
+        }();
+        return rate;
+    }
+
+    void calibrate() {
+        SteadyClock::time_point t = SteadyClock::now();
+        Ticks c = now();
+        if (base_ticks == 0) {
+            base_ticks = c;
+            base_time = t;
+            ns_per_tick.store(initialRate(), std::memory_order_relaxed);
+            return;
+        }
+        double elapsed = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(t - base_time).count();
+        if (elapsed > 1.0e8 and c > base_ticks) //: At least 100ms for a precise value
+            ns_per_tick.store(elapsed / (double)(c - base_ticks), std::memory_order_relaxed);
+    }
+    #endif
+
+    void writeName(std::ofstream &file, std::string_view name) {
+        for (char c : name) {
+            if (c == '"' or c == '\\')
+                file << '\\' << c;
+            else if ((unsigned char)c >= 0x20)
+                file << c;
+        }
+    }
+}
+
+double Profiler::ns(Ticks ticks) {
+    #ifdef PROFILER_RDTSC
+    double rate = ns_per_tick.load(std::memory_order_relaxed);
+    return (double)ticks * (rate > 0.0 ? rate : initialRate());
+    #else
+    return (double)ticks;
+    #endif
+}
+
+void Profiler::record(std::string_view name, Ticks start, Ticks end, ui32 depth) {
+    //---Record zone---
+    //      Only this thread writes to its buffer, the position is published after the zone is written
+    ThreadBuffer* b = localBuffer();
+    if (b == nullptr)
+        return;
+    ui64 w = b->write.load(std::memory_order_relaxed);
+    b->zones[w & buffer_mask] = ZoneData{name, start, end, depth};
+    b->write.store(w + 1, std::memory_order_release);
+}
+
+void Profiler::frame() {
+    //---Frame start---
+    #ifdef PROFILER_RDTSC
+    calibrate();
+    #endif
+
+    current_frame++;
+    frame_starts[current_frame % frame_history] = now();
+
+    //: The main thread is the one marking the frames
+    if (current_frame == 1)
+        if (ThreadBuffer* b = localBuffer())
+            main_slot = b->slot;
+
+    //: Save the captures that are finished
+    for (auto it = captures.begin(); it != captures.end();) {
+        if (it->last < current_frame) {
+            dump(it->path, it->first, it->last);
+            it = captures.erase(it);
+        } else {
+            it++;
+        }
+    }
+}
+
+ui64 Profiler::currentFrame() {
+    return current_frame;
+}
+
+void Profiler::capture(str path, ui32 frames) {
+    //---Capture---
+    //      The next frames, saved when the last one finishes
+    captures.push_back(Capture{path, current_frame + 1, current_frame + std::max(frames, 1u)});
+}
+
+bool Profiler::dump(str path, ui64 first, ui64 last) {
+    //---Dump frames---
+    //      Chrome trace format, a list of complete events ("X") with the start and duration in microseconds
+    //      (https://docs.google.com/document/d/1CvAClvFfyA5R-PhYUmn5OOQtYMH4h6I0nSsKvqReSJFUxb8F4Hc2xkl4JLhZFCrzqpc8)
+    if (first == 0 or first > last or last >= current_frame or current_frame - first >= frame_history) {
+        log::warn("The profiler frames %d to %d are not available", (int)first, (int)last);
+        return false;
+    }
+
+    std::ofstream file(path);
+    if (not file.is_open()) {
+        log::warn("Couldn't open the profiler capture file %s", path.c_str());
+        return false;
+    }
+
+    Ticks begin = frame_starts[first % frame_history];
+    Ticks end = frame_starts[(last + 1) % frame_history];
+    auto us = [begin](Ticks t){ return Profiler::ns(t - begin) * 1.0e-3; };
+
+    file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    file.precision(3);
+    file << std::fixed;
+
+    //: Frames, on the main thread
+    for (ui64 f = first; f <= last; f++) {
+        Ticks start = frame_starts[f % frame_history];
+        Ticks next = frame_starts[(f + 1) % frame_history];
+        file << "{\"name\":\"frame\",\"ph\":\"X\",\"pid\":0,\"tid\":" << main_slot << ",\"ts\":" << us(start)
+             << ",\"dur\":" << Profiler::ns(next - start) * 1.0e-3 << ",\"args\":{\"frame\":" << f << "}},\n";
+    }
+
+    ui32 count = std::min(buffers.count.load(std::memory_order_acquire), Jobs::max_threads);
+    for (ui32 i = 0; i < count; i++) {
+        ThreadBuffer* b = buffers.list[i].load(std::memory_order_acquire);
+        if (b == nullptr)
+            continue;
+
+        //: Thread name
+        str name = b->slot == main_slot ? "main" : (b->job_index > 0 ? "worker " + std::to_string(b->job_index) : "thread " + std::to_string(b->slot));
+        file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << b->slot << ",\"args\":{\"name\":\"" << name << "\"}},\n";
+
+        //: Zones that started inside the range and are still in the ring
+        ui64 w = b->write.load(std::memory_order_acquire);
+        for (ui64 z = w > buffer_size ? w - buffer_size : 0; z < w; z++) {
+            const ZoneData &zone = b->zones[z & buffer_mask];
+            if (zone.start < begin or zone.start >= end)
+                continue;
+            file << "{\"name\":\"";
+            writeName(file, zone.name);
+            file << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << b->slot << ",\"ts\":" << us(zone.start)
+                 << ",\"dur\":" << Profiler::ns(zone.end - zone.start) * 1.0e-3 << ",\"args\":{\"depth\":" << zone.depth << "}},\n";
+        }
+    }
+
+    //: Metadata event last, so the list doesn't end with a comma
+    file << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":0,\"args\":{\"name\":\"fresa\"}}\n]}\n";
+    log::info("Profiler capture saved to %s (frames %d to %d)", path.c_str(), (int)first, (int)last);
+    return true;
+}
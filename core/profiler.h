@@ -0,0 +1,90 @@
+//project fresa, 2017-2022
+//by jose pazos perez
+//licensed under GPLv3 uwu
+
+#pragma once
+
+#include "types.h"
+#include <atomic>
+#include <chrono>
+
+#if defined(__x86_64__) or defined(__i386__)
+#include <x86intrin.h>
+#define PROFILER_RDTSC
+#elif defined(_M_X64) or defined(_M_IX86)
+#include <intrin.h>
+#define PROFILER_RDTSC
+#endif
+
+//---Profiler---
+//      Hierarchical frame profiler. A zone measures the scope where it is declared, and zones declared inside it are nested below it:
+//      void update() {
+//          PROFILE("update");
+//          { PROFILE("collisions"); ... }
+//      }
+//      Each thread writes its zones to its own ring buffer, without locks or allocations, and timestamps use the cpu counter (rdtsc)
+//      when it is available (steady_clock otherwise), so a zone costs a few nanoseconds and the profiler can stay enabled in release
+//      builds. It can be compiled out with DISABLE_PROFILER
+//      The game loop marks the start of every frame. The last frames can be saved in the Chrome trace format (which can be opened in
+//      chrome://tracing or https://ui.perfetto.dev) to analyze stutters offline:
+//      Profiler::capture("trace.json", 60); //: Saves the next 60 frames once they finish
+//      Profiler::dump("trace.json", first, last); //: Saves frames that already happened, if they are still in the buffers
+
+namespace Fresa::Profiler
+{
+    using Ticks = ui64;
+
+    //: Current timestamp, in cpu ticks or nanoseconds
+    inline Ticks now() {
+        #ifdef PROFILER_RDTSC
+        return __rdtsc();
+        #else
+        return (Ticks)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        #endif
+    }
+
+    //: Converts a difference of timestamps to nanoseconds
+    double ns(Ticks ticks);
+
+    //: Saves a finished zone in the buffer of the current thread (use Zone instead)
+    void record(std::string_view name, Ticks start, Ticks end, ui32 depth);
+
+    //: Nesting level of the zones of this thread
+    inline thread_local ui32 zone_depth = 0;
+
+    struct Zone {
+        Zone(std::string_view p_name) : name(p_name), depth(zone_depth++), start(now()) {}
+        ~Zone() {
+            Ticks end = now();
+            zone_depth--;
+            #ifndef DISABLE_PROFILER
+            record(name, start, end, depth);
+            #endif
+        }
+        Zone(const Zone &) = delete;
+        Zone &operator=(const Zone &) = delete;
+
+        //: Time since the zone started, in milliseconds
+        double ms() const { return Profiler::ns(now() - start) * 1.0e-6; }
+
+        std::string_view name;
+        ui32 depth;
+        Ticks start;
+    };
+
+    //---Frames---
+    //      Called by the game loop at the start of every frame, from the main thread. Also saves the pending captures
+    void frame();
+    ui64 currentFrame();
+
+    //---Capture---
+    //      Writes the zones of all threads between the start of the first frame and the end of the last one as a Chrome trace json file
+    //      Call them from the main thread between frames, when the job threads are not recording (capture does this automatically)
+    //      Only the last frames are kept, dump returns false if the range is no longer available
+    void capture(str path, ui32 frames = 1);
+    bool dump(str path, ui64 first, ui64 last);
+}
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE(name) Fresa::Profiler::Zone PROFILE_CONCAT(profile_zone_, __LINE__){name}
@@ -0,0 +1,213 @@
+//project fresa, 2017-2022
+//by jose pazos perez
+//licensed under GPLv3 uwu
+
+#include "task.h"
+#include "jobs.h"
+#include "log.h"
+
+#include <mutex>
+
+using namespace Fresa;
+
+namespace {
+    //---Frame pool---
+    //      Coroutine frames are rounded up to size classes of 64 bytes and kept in a free list per class. Blocks of frames are allocated when
+    //      a class runs out and never released, so the pool grows to the peak number of live tasks. Big frames use the general allocator
+    constexpr size_t frame_class_size = 64;
+    constexpr size_t frame_classes = 32;
+    constexpr size_t frames_per_block = 32;
+
+    struct FreeFrame {
+        FreeFrame* next;
+    };
+    std::array<FreeFrame*, frame_classes> free_frames{};
+    std::vector<std::unique_ptr<ui8[]>> frame_blocks{};
+
+    //---Task list---
+    //      Live tasks, with a version per slot so ids of finished tasks (still waiting in a timer or an event) are ignored
+    struct TaskSlot {
+        Task::Handle handle = nullptr;
+        ui32 version = 0;
+    };
+    std::vector<TaskSlot> tasks{};
+    std::vector<ui32> free_tasks{};
+    size_t task_count = 0;
+
+    std::vector<TaskID> ready{};
+    std::vector<TaskID> woken{}; //: Scheduled from other threads, moved to the ready list at the start of each update
+    std::mutex woken_mutex;
+    std::vector<std::pair<TaskID, std::function<bool()>>> polls{};
+
+    //: The task lists and the frame pool are not synchronized, so they can't be used from the job workers (parallel systems or chunks)
+    void checkThread() {
+        if (Jobs::isWorker())
+            log::error("Tasks can only be started or scheduled by the thread that runs the simulation, not by a job worker");
+    }
+
+    TaskSlot* getTask(TaskID id) {
+        ui32 index = (ui32)(id >> 32);
+        if (index >= tasks.size() or tasks[index].handle == nullptr or tasks[index].version != (ui32)id)
+            return nullptr;
+        return &tasks[index];
+    }
+
+    void destroyTask(TaskSlot &slot) {
+        Task::Handle handle = slot.handle;
+        slot.handle = nullptr;
+        slot.version++;
+        free_tasks.push_back((ui32)(&slot - tasks.data()));
+        task_count--;
+        handle.destroy();
+    }
+
+    void resume(TaskID id) {
+        TaskSlot* slot = getTask(id);
+        if (slot == nullptr)
+            return;
+
+        Task::Handle handle = slot->handle;
+        handle.resume();
+
+        //: The slot can't be used after resuming, the task might have started others
+        if (handle.done()) {
+            std::exception_ptr exception = handle.promise().exception;
+            destroyTask(*getTask(id));
+            if (exception)
+                std::rethrow_exception(exception);
+        }
+    }
+}
+
+void* Task::promise_type::operator new(size_t size) {
+    checkThread();
+    size_t c = (size + frame_class_size - 1) / frame_class_size;
+    if (c > frame_classes)
+        return ::operator new(size);
+
+    FreeFrame* &list = free_frames[c - 1];
+    if (list == nullptr) {
+        size_t frame_size = c * frame_class_size;
+        frame_blocks.push_back(std::make_unique<ui8[]>(frame_size * frames_per_block));
+        for (size_t i = 0; i < frames_per_block; i++) {
+            FreeFrame* frame = reinterpret_cast<FreeFrame*>(frame_blocks.back().get() + i * frame_size);
+            frame->next = list;
+            list = frame;
+        }
+    }
+
+    FreeFrame* frame = list;
+    list = frame->next;
+    return frame;
+}
+
+void Task::promise_type::operator delete(void* p, size_t size) {
+    size_t c = (size + frame_class_size - 1) / frame_class_size;
+    if (c > frame_classes) {
+        ::operator delete(p);
+        return;
+    }
+
+    FreeFrame* frame = static_cast<FreeFrame*>(p);
+    frame->next = free_frames[c - 1];
+    free_frames[c - 1] = frame;
+}
+
+TaskID Tasks::start(Task task) {
+    checkThread();
+    ui32 index;
+    if (not free_tasks.empty()) {
+        index = free_tasks.back();
+        free_tasks.pop_back();
+    } else {
+        index = (ui32)tasks.size();
+        tasks.push_back(TaskSlot{});
+    }
+
+    TaskID id = ((TaskID)index << 32) | tasks[index].version;
+    tasks[index].handle = std::exchange(task.handle, nullptr);
+    tasks[index].handle.promise().id = id;
+    task_count++;
+
+    //: Run until the first co_await
+    resume(id);
+    return id;
+}
+
+void Tasks::stop(TaskID id) {
+    checkThread();
+    if (TaskSlot* slot = getTask(id))
+        destroyTask(*slot);
+}
+
+bool Tasks::running(TaskID id) {
+    return getTask(id) != nullptr;
+}
+
+void Tasks::schedule(TaskID id) {
+    checkThread();
+    ready.push_back(id);
+}
+
+void Tasks::wake(TaskID id) {
+    std::lock_guard<std::mutex> lock(woken_mutex);
+    woken.push_back(id);
+}
+
+void Tasks::poll(TaskID id, std::function<bool()> f) {
+    checkThread();
+    polls.push_back({id, std::move(f)});
+}
+
+void Tasks::update() {
+    //: Tasks woken from other threads
+    {
+        std::lock_guard<std::mutex> lock(woken_mutex);
+        ready.insert(ready.end(), woken.begin(), woken.end());
+        woken.clear();
+    }
+
+    //: Check the polled conditions, removing the ones that are done or whose task was stopped
+    for (size_t i = 0; i < polls.size();) {
+        if (getTask(polls[i].first) == nullptr or polls[i].second()) {
+            if (getTask(polls[i].first) != nullptr)
+                schedule(polls[i].first);
+            polls[i] = std::move(polls.back());
+            polls.pop_back();
+        } else {
+            i++;
+        }
+    }
+
+    //: Resume the ready tasks, the ones scheduled while resuming wait for the next update
+    std::vector<TaskID> current = std::move(ready);
+    ready.clear();
+    for (size_t i = 0; i < current.size(); i++) {
+        try {
+            resume(current[i]);
+        } catch (...) {
+            //: The tasks that were not resumed yet go back to the ready list, so they are not left suspended forever
+            ready.insert(ready.begin(), current.begin() + i + 1, current.end());
+            throw;
+        }
+    }
+
+    //: Keep the capacity of the ready list, but not over the tasks that were scheduled while resuming
+    current.clear();
+    if (ready.empty())
+        std::swap(ready, current);
+}
+
+void Tasks::clear() {
+    for (auto &slot : tasks)
+        if (slot.handle != nullptr)
+            destroyTask(slot);
+    ready.clear();
+    polls.clear();
+    std::lock_guard<std::mutex> lock(woken_mutex);
+    woken.clear();
+}
+
+size_t Tasks::count() {
+    return task_count;
+}
@@ -0,0 +1,193 @@
+//project fresa, 2017-2022
+//by jose pazos perez
+//licensed under GPLv3 uwu
+
+#pragma once
+
+#include "types.h"
+#include "events.h"
+#include "channel.h"
+#include "f_time.h"
+
+#include <atomic>
+#include <coroutine>
+#include <future>
+#include <optional>
+#include <tuple>
+#include <utility>
+
+//---Tasks---
+//      Coroutines for sequential gameplay logic that spans multiple frames. A function that returns Task can co_await the next physics tick,
+//      an amount of game time, an event or a future (for example an asset loaded in another thread), and it continues where it left off:
+//      Task intro() {
+//          co_await Tasks::wait(500);
+//          Audio::play(sound);
+//          Key key = co_await Tasks::event(Input::event_key_down);
+//          co_await Tasks::nextTick();
+//      }
+//      Tasks::start(intro());
+//      Tasks belong to the thread that runs the simulation: the main thread, or the simulation thread of the pipelined mode while it runs a
+//      frame (the main thread can use them between frames, while it waits). They start right away until the first co_await, and after
+//      that they are resumed by Tasks::update(), called by the game loop every physics iteration, so waiting always takes at least one tick
+//      The task lists are not synchronized, so starting, stopping or scheduling a task from a job worker (a system running in parallel or a
+//      parallel_each chunk) is an error. Event can be published from any thread, the task is woken and resumed in the next update
+//      If a task throws, the exception is rethrown by Tasks::update() and the tasks that were not resumed yet wait for the next update
+//      Coroutine frames come from a pool, so starting and finishing tasks doesn't allocate once the pool has grown to the number of live tasks
+
+namespace Fresa
+{
+    using TaskID = ui64;
+
+    struct Task {
+        struct promise_type {
+            TaskID id = 0;
+            std::exception_ptr exception;
+
+            Task get_return_object() { return Task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+            std::suspend_always initial_suspend() noexcept { return {}; }
+            std::suspend_always final_suspend() noexcept { return {}; }
+            void return_void() {}
+            void unhandled_exception() { exception = std::current_exception(); }
+
+            //: Frames are allocated from the task pool
+            static void* operator new(size_t size);
+            static void operator delete(void* p, size_t size);
+        };
+        using Handle = std::coroutine_handle<promise_type>;
+
+        Task(Handle h) : handle(h) {}
+        Task(Task &&other) : handle(std::exchange(other.handle, nullptr)) {}
+        Task(const Task &) = delete;
+        Task &operator=(const Task &) = delete;
+        ~Task() { if (handle) handle.destroy(); }
+
+        Handle handle;
+    };
+
+    namespace Tasks
+    {
+        //: Starts running a task, it can be stopped later using the id (but not from inside the task itself)
+        TaskID start(Task task);
+        void stop(TaskID id);
+        bool running(TaskID id);
+
+        //: Resumes the tasks that are ready, called by the game loop
+        void update();
+
+        //: Destroys all the tasks (on exit)
+        void clear();
+        size_t count();
+
+        //: Resumes the task in the next update (used by the awaitables), wake can be called from any thread
+        void schedule(TaskID id);
+        void wake(TaskID id);
+        void poll(TaskID id, std::function<bool()> ready);
+
+        //---Awaitables---
+
+        //: Next physics tick
+        struct NextTick {
+            bool await_ready() { return false; }
+            void await_suspend(Task::Handle h) { schedule(h.promise().id); }
+            void await_resume() {}
+        };
+        inline NextTick nextTick() { return {}; }
+
+        //: Time (game time by default, so it is scaled by the game speed), using the timer system
+        struct Wait {
+            ui32 ms;
+            TimerScale scale;
+            std::optional<TimerID> timer{};
+
+            bool await_ready() { return false; }
+            void await_suspend(Task::Handle h) {
+                TaskID id = h.promise().id;
+                timer = callbackTimer(ms, [id](){ schedule(id); }, scale);
+            }
+            void await_resume() {}
+
+            //: If the task is stopped while waiting, cancel the timer (ids of finished timers are ignored)
+            ~Wait() { if (timer) stopTimer(*timer); }
+        };
+        inline Wait wait(ui32 ms, TimerScale scale = TIMER_GAME) { return Wait{ms, scale}; }
+
+        //: Event fired, returns the arguments (nothing, the value or a tuple if there are many)
+        template <typename E, typename... Args>
+        struct EventAwaiter {
+            E &event;
+            std::optional<std::tuple<Args...>> value{};
+            Event::Observer observer{};
+
+            bool await_ready() { return false; }
+            void await_suspend(Task::Handle h) {
+                TaskID id = h.promise().id;
+                observer = event.createObserver([this, id](const Args &... a){
+                    if (value)
+                        return;
+                    value.emplace(a...);
+                    observer.reset();
+                    schedule(id);
+                });
+            }
+            auto await_resume() {
+                if constexpr (sizeof...(Args) == 1)
+                    return std::get<0>(std::move(*value));
+                else if constexpr (sizeof...(Args) > 1)
+                    return std::move(*value);
+            }
+        };
+
+        //: Event can be published from any thread, so the value is shared with the handler (another thread might still be running it when
+        //  the task resumes) and the task is woken instead of scheduled. The observer is only removed on the main thread, with the awaiter
+        template <typename... Args>
+        struct EventAwaiter<Event::Event<Args...>, Args...> {
+            struct Shared {
+                std::atomic<bool> fired = false;
+                std::optional<std::tuple<Args...>> value{};
+            };
+            Event::Event<Args...> &event;
+            std::shared_ptr<Shared> shared = std::make_shared<Shared>();
+            typename Event::Event<Args...>::Observer observer{};
+
+            bool await_ready() { return false; }
+            void await_suspend(Task::Handle h) {
+                TaskID id = h.promise().id;
+                observer = event.createObserver([shared = shared, id](const Args &... a){
+                    if (shared->fired.exchange(true))
+                        return;
+                    shared->value.emplace(a...);
+                    wake(id);
+                });
+            }
+            auto await_resume() {
+                if constexpr (sizeof...(Args) == 1)
+                    return std::get<0>(std::move(*shared->value));
+                else if constexpr (sizeof...(Args) > 1)
+                    return std::move(*shared->value);
+            }
+        };
+
+        template <typename... Args>
+        EventAwaiter<Event::LocalEvent<Args...>, Args...> event(Event::LocalEvent<Args...> &e) { return {e}; }
+
+        template <typename... Args>
+        EventAwaiter<Event::Event<Args...>, Args...> event(Event::Event<Args...> &e) { return {e}; }
+        
+        template <typename... Args>
+        EventAwaiter<Event::Channel<Args...>, Args...> event(Event::Channel<Args...> &e) { return {e}; }
+
+        //: Future ready (assets or anything loaded in another thread), returns its value
+        template <typename T>
+        struct FutureAwaiter {
+            std::future<T> &future;
+
+            bool ready() { return future.wait_for(std::chrono::seconds(0)) == std::future_status::ready; }
+            bool await_ready() { return ready(); }
+            void await_suspend(Task::Handle h) { poll(h.promise().id, [this](){ return ready(); }); }
+            T await_resume() { return future.get(); }
+        };
+
+        template <typename T>
+        FutureAwaiter<T> loaded(std::future<T> &f) { return {f}; }
+    }
+}
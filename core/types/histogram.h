@@ -0,0 +1,103 @@
+//project fresa, 2017-2022
+//by jose pazos perez
+//licensed under GPLv3 uwu
+
+#pragma once
+
+#include "types.h"
+#include <bit>
+#include <cmath>
+#include <algorithm>
+
+//---Histogram---
+//      Log linear histogram (in the style of HdrHistogram) for timings. Values are stored in microseconds. The buckets are exact up to
+//      32us, and after that every power of two is split in 16 linear buckets, so any value is off by at most 1/16 (~6%) with a fixed
+//      size of a few kilobytes. Adding a value is O(1), and percentiles walk the buckets, which is cheap enough to do a few times a second
+//      Histogram h;
+//      h.add(Performance::physics_iteration_time); //: In milliseconds
+//      double p99 = h.percentile(99.0);
+//      Histograms can be merged, so short windows can be combined into longer ones
+
+namespace Fresa
+{
+    struct Histogram {
+        static constexpr ui32 linear_bits = 5;
+        static constexpr ui64 linear_count = 1 << linear_bits;
+        static constexpr ui64 half_count = linear_count / 2;
+        static constexpr ui32 max_exponent = 36; //: Values up to 2^41us (~25 days), the rest go to the last bucket
+        static constexpr ui64 bucket_count = max_exponent * half_count + linear_count;
+
+        //: Add a value in milliseconds
+        void add(double ms) {
+            ui64 us = ms > 0.0 ? (ui64)(ms * 1.0e3 + 0.5) : 0;
+            counts[bucket(us)]++;
+            count++;
+            sum += ms;
+            if (count == 1 or ms < min_value) min_value = ms;
+            if (count == 1 or ms > max_value) max_value = ms;
+        }
+
+        //: Value under which the given percentage (0-100) of the values are, in milliseconds
+        //      It returns the upper edge of the bucket, so it never understates a tail latency (but it is limited to the maximum value)
+        double percentile(double p) const {
+            if (count == 0)
+                return 0.0;
+            ui64 target = (ui64)std::ceil(std::clamp(p, 0.0, 100.0) * 1.0e-2 * (double)count);
+            target = std::max(target, (ui64)1);
+            ui64 accumulated = 0;
+            for (ui64 i = 0; i < bucket_count; i++) {
+                accumulated += counts[i];
+                if (accumulated >= target)
+                    return std::clamp((double)upper(i) * 1.0e-3, min_value, max_value);
+            }
+            return max_value;
+        }
+
+        double mean() const { return count > 0 ? sum / (double)count : 0.0; }
+        double min() const { return min_value; }
+        double max() const { return max_value; }
+        ui64 size() const { return count; }
+
+        void merge(const Histogram &other) {
+            if (other.count == 0)
+                return;
+            for (ui64 i = 0; i < bucket_count; i++)
+                counts[i] += other.counts[i];
+            min_value = count > 0 ? std::min(min_value, other.min_value) : other.min_value;
+            max_value = count > 0 ? std::max(max_value, other.max_value) : other.max_value;
+            count += other.count;
+            sum += other.sum;
+        }
+
+        void reset() { *this = Histogram{}; }
+
+        //---Buckets---
+        //      Below 32us the bucket is the value itself. Above, the exponent e is the number of bits over 5, and the bucket is given by the
+        //      exponent and the top 5 bits of the value (which are between 16 and 31)
+        static ui64 bucket(ui64 us) {
+            ui32 bits = (ui32)std::bit_width(us);
+            if (bits <= linear_bits)
+                return us;
+            ui32 e = std::min(bits - linear_bits, max_exponent);
+            ui64 top = std::min(us >> e, linear_count - 1);
+            return e * half_count + top;
+        }
+
+        //: Highest value (in us) of a bucket
+        static ui64 upper(ui64 index) {
+            if (index < linear_count)
+                return index;
+            ui64 e = index / half_count - 1;
+            ui64 top = index % half_count + half_count;
+            return ((top + 1) << e) - 1;
+        }
+
+        ui64 counts[bucket_count]{};
+
+        private:
+            ui64 count = 0;
+            double sum = 0.0;
+            double min_value = 0.0;
+            double max_value = 0.0;
+    };
+}
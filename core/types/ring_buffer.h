@@ -0,0 +1,85 @@
+//project fresa, 2017-2022
+//by jose pazos perez
+//licensed under GPLv3 uwu
+
+#pragma once
+
+#include "types.h"
+#include <atomic>
+
+//---Ring buffer---
+//      Bounded lock free queue for multiple producers and a single consumer. Every cell has a sequence number that tells if it is free for
+//      the producer of that position or ready for the consumer, so producers only compete for the write position with a compare and swap
+//      and never wait for each other. When the buffer is full push fails instead of blocking. The capacity is rounded to a power of two
+//      (based on the bounded queue by Dmitry Vyukov, https://www.1024cores.net/home/lock-free-algorithms/queues/bounded-mpmc-queue)
+
+namespace Fresa
+{
+    template <typename T>
+    struct RingBuffer {
+        RingBuffer(size_t p_capacity = 1024) {
+            size_t capacity = 2;
+            while (capacity < p_capacity)
+                capacity *= 2;
+            mask = capacity - 1;
+            cells = std::make_unique<Cell[]>(capacity);
+            for (size_t i = 0; i < capacity; i++)
+                cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+        RingBuffer(const RingBuffer &) = delete;
+        RingBuffer &operator=(const RingBuffer &) = delete;
+
+        //: Producers (any thread), returns false if the buffer is full
+        bool push(T value) {
+            Cell* cell;
+            size_t pos = write.load(std::memory_order_relaxed);
+            while (true) {
+                cell = &cells[pos & mask];
+                size_t sequence = cell->sequence.load(std::memory_order_acquire);
+                std::ptrdiff_t diff = (std::ptrdiff_t)sequence - (std::ptrdiff_t)pos;
+                if (diff == 0) {
+                    if (write.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                        break;
+                } else if (diff < 0) {
+                    return false;
+                } else {
+                    pos = write.load(std::memory_order_relaxed);
+                }
+            }
+            cell->value = std::move(value);
+            cell->sequence.store(pos + 1, std::memory_order_release);
+            return true;
+        }
+
+        //: Consumer (only one thread), returns false if the buffer is empty
+        bool pop(T &value) {
+            size_t pos = read.load(std::memory_order_relaxed);
+            Cell &cell = cells[pos & mask];
+            if (cell.sequence.load(std::memory_order_acquire) != pos + 1)
+                return false;
+            value = std::move(cell.value);
+            cell.sequence.store(pos + mask + 1, std::memory_order_release);
+            read.store(pos + 1, std::memory_order_relaxed);
+            return true;
+        }
+
+        //: Approximate number of elements (exact if no producer is pushing)
+        size_t size() const {
+            size_t w = write.load(std::memory_order_relaxed), r = read.load(std::memory_order_relaxed);
+            return w > r ? w - r : 0;
+        }
+        size_t capacity() const { return mask + 1; }
+
+        private:
+            struct Cell {
+                std::atomic<size_t> sequence;
+                T value;
+            };
+            std::unique_ptr<Cell[]> cells;
+            size_t mask;
+
+            //: Positions in different cache lines, since producers and the consumer write them from different threads
+            alignas(64) std::atomic<size_t> write = 0;
+            alignas(64) std::atomic<size_t> read = 0;
+    };
+}
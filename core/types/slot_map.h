@@ -0,0 +1,91 @@
+//project fresa, 2017-2022
+//by jose pazos perez
+//licensed under GPLv3 uwu
+
+#pragma once
+
+#include "types.h"
+#include "log.h"
+
+//---Slot map---
+//      Container that gives out generational handles (32 bit slot index and 32 bit version) with O(1) insertion, lookup and removal
+//      Removed slots are reused with a new version, so the handles to the old value stop being valid instead of pointing to the new one
+//      Values are allocated separately, so references to them stay valid while other values are inserted or removed
+
+namespace Fresa
+{
+    template <typename T>
+    struct SlotMap {
+        using Handle = ui64;
+        static constexpr Handle invalid = Handle(-1);
+
+        static constexpr Handle createHandle(ui32 index, ui32 version) { return ((Handle)index << 32) | version; }
+        static constexpr ui32 getIndex(Handle h) { return (ui32)(h >> 32); }
+        static constexpr ui32 getVersion(Handle h) { return (ui32)h; }
+
+        struct Slot {
+            std::unique_ptr<T> value;
+            ui32 version = 0;
+        };
+        std::vector<Slot> slots;
+        std::vector<ui32> free_slots;
+        size_t count = 0;
+
+        //: Insert
+        Handle insert(T &&value) {
+            return insert(std::make_unique<T>(std::move(value)));
+        }
+
+        Handle insert(std::unique_ptr<T> value) {
+            ui32 index;
+            if (not free_slots.empty()) {
+                index = free_slots.back();
+                free_slots.pop_back();
+            } else {
+                index = (ui32)slots.size();
+                slots.push_back(Slot{});
+            }
+            slots[index].value = std::move(value);
+            count++;
+            return createHandle(index, slots[index].version);
+        }
+
+        //: Lookup
+        bool contains(Handle h) const {
+            ui32 index = getIndex(h);
+            return index < slots.size() and slots[index].value != nullptr and slots[index].version == getVersion(h);
+        }
+
+        T* get(Handle h) {
+            return contains(h) ? slots[getIndex(h)].value.get() : nullptr;
+        }
+
+        T& at(Handle h) {
+            if (not contains(h))
+                log::error("Accessing a slot map with an invalid handle");
+            return *slots[getIndex(h)].value;
+        }
+
+        //: Remove (the slot gets a new version, and it is retired if it runs out of them)
+        void erase(Handle h) {
+            if (not contains(h))
+                return;
+            Slot &slot = slots[getIndex(h)];
+            slot.value.reset();
+            count--;
+            if (++slot.version != ui32(-1))
+                free_slots.push_back(getIndex(h));
+        }
+
+        size_t size() const { return count; }
+        bool empty() const { return count == 0; }
+
+        //: Calls f(handle, value) for each value
+        template <typename F>
+        void each(F &&f) {
+            for (ui32 i = 0; i < slots.size(); i++)
+                if (slots[i].value != nullptr)
+                    f(createHandle(i, slots[i].version), *slots[i].value);
+        }
+    };
+}
@@ -5,7 +5,9 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <vector>
+#include <array>
 #include <algorithm>
 #include <ostream>
 
@@ -67,4 +69,73 @@ namespace Fresa
     inline str list_contents(str s) {
         return s.substr(1, s.size() - 2);
     }
+    inline std::string_view list_contents(std::string_view s) {
+        return s.size() >= 2 ? s.substr(1, s.size() - 2) : std::string_view{};
+    }
+    
+    //---String views---
+    //      Versions of the helpers that return views into the original string, so parsing doesn't allocate
+    
+    //: Trim
+    inline std::string_view trimmed(std::string_view s) {
+        size_t a = s.find_first_not_of(" \t\r\n");
+        if (a == std::string_view::npos)
+            return {};
+        return s.substr(a, s.find_last_not_of(" \t\r\n") - a + 1);
+    }
+    
+    //: Compare ignoring the case (only ascii)
+    constexpr char lower_char(char c) {
+        return (c >= 'A' and c <= 'Z') ? (char)(c - 'A' + 'a') : c;
+    }
+    constexpr bool equals_lower(std::string_view a, std::string_view b) {
+        if (a.size() != b.size())
+            return false;
+        for (size_t i = 0; i < a.size(); i++)
+            if (lower_char(a[i]) != lower_char(b[i]))
+                return false;
+        return true;
+    }
+    
+    //: Tokenizer
+    //      Goes through the parts of a string separated by a delimiter like split, but as views and one at a time
+    //      Tokenizer t(line, ",");
+    //      for (std::string_view part; t.next(part);) ...
+    struct Tokenizer {
+        Tokenizer(std::string_view p_s, std::string_view p_del = " ", bool p_recursive = false) : s(p_s), del(p_del), recursive(p_recursive) {}
+        
+        bool next(std::string_view &token) {
+            if (done)
+                return false;
+            size_t end = s.find(del, pos);
+            if (end == std::string_view::npos) {
+                token = s.substr(pos);
+                done = true;
+                return true;
+            }
+            token = s.substr(pos, end - pos);
+            pos = end + del.size();
+            if (recursive)
+                while (s.substr(pos, del.size()) == del)
+                    pos += del.size();
+            return true;
+        }
+        
+        //: Fills the array with the next tokens and returns how many there were (it can be more than the size of the array)
+        template <size_t N>
+        size_t next(std::array<std::string_view, N> &tokens) {
+            size_t n = 0;
+            for (std::string_view token; next(token); n++)
+                if (n < N)
+                    tokens[n] = token;
+            return n;
+        }
+        
+        private:
+            std::string_view s;
+            std::string_view del;
+            bool recursive;
+            size_t pos = 0;
+            bool done = false;
+    };
 }
@@ -0,0 +1,115 @@
+//project fresa, 2017-2022
+//by jose pazos perez
+//licensed under GPLv3 uwu
+
+#include "command_buffer.h"
+#include "scene.h"
+
+using namespace Fresa;
+
+void EntityCommandBuffer::playback(Scene &scene) {
+    //---Playback---
+    //      First reserve all the storage needed (entities and component pools), then apply the commands in order
+    //      The archetype of the entities that get new components is only updated once at the end
+    if (commands.empty())
+        return;
+    
+    //: Reserve entities
+    size_t recyclable = scene.free_entities.size() > scene.recycle_delay ? scene.free_entities.size() - scene.recycle_delay : 0;
+    size_t new_entities = created > recyclable ? created - recyclable : 0;
+    size_t total = scene.entities.size() + new_entities;
+    scene.entities.reserve(total);
+    scene.mask.reserve(total);
+    scene.entity_names.reserve(total);
+    scene.entity_archetype.reserve(total);
+    scene.entity_row.reserve(total);
+    
+    //: Reserve components
+    std::vector<ui32> added(MAX_COMPONENTS, 0);
+    std::vector<const ComponentOps*> added_ops(MAX_COMPONENTS, nullptr);
+    for (auto &c : commands) {
+        if (c.type == COMMAND_ADD_COMPONENT) {
+            added[c.cid]++;
+            added_ops[c.cid] = c.ops;
+        }
+    }
+    for (ComponentID cid = 0; cid < MAX_COMPONENTS; cid++) {
+        if (added[cid] == 0)
+            continue;
+        if (scene.component_pools.size() <= cid)
+            scene.component_pools.resize(cid + 1);
+        if (scene.component_pools[cid] == nullptr) {
+            scene.component_pools[cid].reset(added_ops[cid]->create_pool());
+            scene.component_pools[cid]->tick = scene.tick;
+        }
+        scene.component_pools[cid]->reserve(scene.component_pools[cid]->size() + added[cid]);
+    }
+    
+    //: Apply
+    std::vector<EntityID> placeholders(created);
+    std::vector<Entity::EntityIndex> touched;
+    
+    auto resolve = [&](EntityID eid) { return isPlaceholder(eid) ? placeholders.at(Entity::getIndex(eid)) : eid; };
+    
+    for (auto &c : commands) {
+        EntityID eid = c.type == COMMAND_CREATE ? c.eid : resolve(c.eid);
+        Entity::EntityIndex index = Entity::getIndex(eid);
+        
+        switch (c.type) {
+            case COMMAND_CREATE: {
+                placeholders.at(index) = scene.createEntity(names.at(index));
+                break;
+            } case COMMAND_REMOVE_ENTITY: {
+                if (scene.isValid(eid))
+                    scene.removeEntity(eid);
+                break;
+            } case COMMAND_ADD_COMPONENT: {
+                if (not scene.isValid(eid))
+                    break;
+                c.ops->move(scene.component_pools[c.cid]->add(eid), c.value);
+                c.value = nullptr;
+                scene.mask[index].set(c.cid);
+                touched.push_back(index);
+                break;
+            } case COMMAND_REMOVE_COMPONENT: {
+                if (scene.isValid(eid))
+                    scene.removeComponent(eid, c.cid);
+                break;
+            }
+        }
+    }
+    
+    for (auto index : touched)
+        scene.updateArchetype(index);
+    
+    clear();
+}
+
+void EntityCommandBuffer::clear() {
+    //: Destroy the values that were not moved into the scene
+    for (auto &c : commands)
+        if (c.value != nullptr)
+            c.ops->destroy(c.value);
+    
+    commands.clear();
+    names.clear();
+    created = 0;
+    
+    //: Keep the blocks for the next frame
+    for (auto &b : blocks)
+        b.used = 0;
+}
+
+void* EntityCommandBuffer::allocate(size_t size, size_t align) {
+    for (auto &b : blocks) {
+        size_t offset = (b.used + align - 1) / align * align;
+        if (offset + size <= b.size) {
+            b.used = offset + size;
+            return b.data.get() + offset;
+        }
+    }
+    
+    size_t new_size = std::max(block_size, size);
+    blocks.push_back(Block{std::make_unique<ui8[]>(new_size), new_size, size});
+    return blocks.back().data.get();
+}
@@ -0,0 +1,115 @@
+//project fresa, 2017-2022
+//by jose pazos perez
+//licensed under GPLv3 uwu
+
+#pragma once
+
+#include "ecs.h"
+#include "cpool.h"
+#include <cstddef>
+
+//---Entity command buffer---
+//      Records structural changes (creating and removing entities, adding and removing components) to apply them later, at a sync point of
+//      the frame, when no view is iterating and no system is running in parallel. Each thread has its own buffer in the scene:
+//      EntityCommandBuffer &cmd = scene.commands();
+//      EntityID bullet = cmd.createEntity("bullet");
+//      cmd.addComponent<Position>(bullet, Position{x, y});
+//      The id returned by createEntity is a placeholder that can only be used inside the same buffer until it is played back
+//      When played back, the storage for all the new entities and components is reserved at once before applying the commands
+
+namespace Fresa
+{
+    struct Scene;
+
+    struct EntityCommandBuffer {
+        EntityCommandBuffer() = default;
+        EntityCommandBuffer(EntityCommandBuffer &&other) = default;
+        EntityCommandBuffer &operator=(EntityCommandBuffer &&other) = default;
+        ~EntityCommandBuffer() { clear(); }
+
+        //: Type erased operations for component values
+        struct ComponentOps {
+            size_t size;
+            size_t align;
+            ComponentPool::MoveFunction move;
+            ComponentPool::DestroyFunction destroy;
+            ComponentPool* (*create_pool)();
+        };
+
+        template <typename C>
+        static const ComponentOps* getOps() {
+            static const ComponentOps ops{ sizeof(C), alignof(C),
+                [](void* dst, void* src){ new (dst) C(std::move(*static_cast<C*>(src))); static_cast<C*>(src)->~C(); },
+                [](void* p){ static_cast<C*>(p)->~C(); },
+                [](){ return ComponentPool::create<C>(); } };
+            return &ops;
+        }
+
+        //: Commands
+        enum CommandType {
+            COMMAND_CREATE,
+            COMMAND_REMOVE_ENTITY,
+            COMMAND_ADD_COMPONENT,
+            COMMAND_REMOVE_COMPONENT,
+        };
+
+        struct Command {
+            CommandType type;
+            EntityID eid;
+            ComponentID cid = 0;
+            void* value = nullptr;
+            const ComponentOps* ops = nullptr;
+        };
+
+        std::vector<Command> commands;
+        std::vector<str> names;
+        ui32 created = 0;
+
+        //: Placeholder ids for the entities created in this buffer
+        static constexpr Entity::EntityVersion placeholder_version = Entity::EntityVersion(-1);
+        static bool isPlaceholder(EntityID eid) { return Entity::getVersion(eid) == placeholder_version; }
+
+        //: Record
+        EntityID createEntity(str name = "") {
+            EntityID eid = Entity::createID(created++, placeholder_version);
+            names.push_back(name);
+            commands.push_back(Command{COMMAND_CREATE, eid});
+            return eid;
+        }
+
+        void removeEntity(EntityID eid) {
+            commands.push_back(Command{COMMAND_REMOVE_ENTITY, eid});
+        }
+
+        template <typename C>
+        void addComponent(EntityID eid, C value = {}) {
+            static_assert(alignof(C) <= alignof(std::max_align_t), "Over aligned components are not supported in command buffers");
+            const ComponentOps* ops = getOps<C>();
+            void* p = new (allocate(ops->size, ops->align)) C(std::move(value));
+            commands.push_back(Command{COMMAND_ADD_COMPONENT, eid, Component::getID<C>(), p, ops});
+        }
+
+        template <typename C>
+        void removeComponent(EntityID eid) {
+            commands.push_back(Command{COMMAND_REMOVE_COMPONENT, eid, Component::getID<C>()});
+        }
+
+        //: Apply all the commands to the scene and clear the buffer
+        void playback(Scene &scene);
+
+        bool empty() const { return commands.empty(); }
+        void clear();
+
+        private:
+            //: Storage for the component values, in blocks that are never reallocated so the values don't move
+            static constexpr size_t block_size = 16384;
+            struct Block {
+                std::unique_ptr<ui8[]> data;
+                size_t size;
+                size_t used;
+            };
+            std::vector<Block> blocks;
+
+            void* allocate(size_t size, size_t align);
+    };
+}
@@ -3,18 +3,143 @@
 //licensed under GPLv3 uwu
 
 #include "cpool.h"
+#include "log.h"
+#include <algorithm>
 
 using namespace Fresa;
 
-ComponentPool::ComponentPool(size_t p_size) {
-    element_size = p_size;
-    pool_data = new ui8[element_size * MAX_ENTITIES];
-}
+ComponentPool::ComponentPool(size_t p_size, MoveFunction p_move, DestroyFunction p_destroy) :
+element_size(p_size), move_f(p_move), destroy_f(p_destroy) {}
 
 ComponentPool::~ComponentPool() {
-    delete[] pool_data;
+    for (size_t i = 0; i < entities.size(); i++)
+        destroy_f(at(i));
+    for (ui8* page : pages)
+        ::operator delete[](page, std::align_val_t(page_alignment));
+}
+
+void* ComponentPool::add(EntityID eid) {
+    Entity::EntityIndex index = Entity::getIndex(eid);
+
+    //: Already has this component, destroy the previous one and reuse the slot
+    if (has(index)) {
+        ui32 dense = sparseAt(index);
+        void* p = at(dense);
+        destroy_f(p);
+        entities[dense] = eid;
+        added_ticks[dense] = tick;
+        changed_ticks[dense] = tick;
+        return p;
+    }
+
+    if (entities.size() == capacity())
+        reserve(capacity() + page_size);
+
+    sparseAt(index) = (ui32)entities.size();
+    entities.push_back(eid);
+    added_ticks.push_back(tick);
+    changed_ticks.push_back(tick);
+    return at(entities.size() - 1);
+}
+
+void* ComponentPool::get(Entity::EntityIndex index) {
+    ui32 dense = find(index);
+    return dense == invalid_index ? nullptr : at(dense);
+}
+
+bool ComponentPool::has(Entity::EntityIndex index) const {
+    return find(index) != invalid_index;
+}
+
+ui32 ComponentPool::find(Entity::EntityIndex index) const {
+    size_t page = index >> sparse_page_shift;
+    if (page >= sparse.size() or sparse[page] == nullptr)
+        return invalid_index;
+    return sparse[page][index & (sparse_page_size - 1)];
+}
+
+void ComponentPool::remove(Entity::EntityIndex index) {
+    if (not has(index))
+        return;
+
+    ui32 removed = sparseAt(index);
+    ui32 last = (ui32)entities.size() - 1;
+
+    destroy_f(at(removed));
+
+    //: Swap the last element into the hole to keep the dense array packed
+    if (removed != last) {
+        move_f(at(removed), at(last));
+        entities[removed] = entities[last];
+        added_ticks[removed] = added_ticks[last];
+        changed_ticks[removed] = changed_ticks[last];
+        sparseAt(Entity::getIndex(entities[removed])) = removed;
+    }
+
+    entities.pop_back();
+    added_ticks.pop_back();
+    changed_ticks.pop_back();
+    sparseAt(index) = invalid_index;
+}
+
+void ComponentPool::reserve(size_t n) {
+    //: New pages are appended, the existing ones are never moved
+    while (capacity() < n)
+        pages.push_back(static_cast<ui8*>(::operator new[](element_size * page_size, std::align_val_t(page_alignment))));
+    entities.reserve(capacity());
+    added_ticks.reserve(capacity());
+    changed_ticks.reserve(capacity());
+}
+
+void ComponentPool::copyFrom(const ComponentPool &other) {
+    if (other.copy_f == nullptr)
+        log::error("The component %s can't be copied", str(other.name).c_str());
+    
+    //: Components
+    for (size_t i = 0; i < entities.size(); i++)
+        destroy_f(at(i));
+    entities = other.entities;
+    added_ticks = other.added_ticks;
+    changed_ticks = other.changed_ticks;
+    tick = other.tick;
+    reserve(entities.size());
+    for (size_t i = 0; i < entities.size(); i++)
+        other.copy_f(at(i), other.at(i));
+    
+    //: Sparse pages, the ones the other pool doesn't have are kept empty
+    if (sparse.size() < other.sparse.size())
+        sparse.resize(other.sparse.size());
+    for (size_t page = 0; page < sparse.size(); page++) {
+        bool other_page = page < other.sparse.size() and other.sparse[page] != nullptr;
+        if (other_page and sparse[page] == nullptr)
+            sparse[page] = std::make_unique<ui32[]>(sparse_page_size);
+        if (other_page)
+            std::copy_n(other.sparse[page].get(), sparse_page_size, sparse[page].get());
+        else if (sparse[page] != nullptr)
+            std::fill_n(sparse[page].get(), sparse_page_size, invalid_index);
+    }
+}
+
+size_t ComponentPool::bytesUsed() const {
+    return entities.size() * (element_size + sizeof(EntityID) + 2 * sizeof(ui32));
+}
+
+size_t ComponentPool::bytesReserved() const {
+    size_t sparse_pages = std::count_if(sparse.begin(), sparse.end(), [](const auto &page){ return page != nullptr; });
+    return capacity() * element_size +
+           entities.capacity() * sizeof(EntityID) +
+           (added_ticks.capacity() + changed_ticks.capacity()) * sizeof(ui32) +
+           sparse_pages * sparse_page_size * sizeof(ui32) + sparse.capacity() * sizeof(sparse[0]) +
+           pages.capacity() * sizeof(ui8*);
 }
 
-void* ComponentPool::get(size_t index) {
-    return pool_data + index * element_size;
+ui32 &ComponentPool::sparseAt(Entity::EntityIndex index) {
+    size_t page = index >> sparse_page_shift;
+    if (sparse.size() <= page)
+        sparse.resize(page + 1);
+    if (sparse[page] == nullptr) {
+        sparse[page] = std::make_unique<ui32[]>(sparse_page_size);
+        std::fill_n(sparse[page].get(), sparse_page_size, invalid_index);
+    }
+    return sparse[page][index & (sparse_page_size - 1)];
 }
@@ -7,18 +7,104 @@
 #include "ecs.h"
 
 //---Component pool---
-//      Somewhat inefficient component allocator pool, it can be improved by using sparse sets, but it is fine for now
+//      Sparse set allocator for one component type. It has a sparse array indexed by the entity index that points to a packed (dense) array
+//      of components, and a packed array of the entities that own them, in the same order. This way all the live components are contiguous and
+//      iterating over them doesn't touch any unused memory. Removing a component moves the last one into its place, so the order is not stable.
+//      Since the pool is type erased, it keeps the functions needed to move and destroy the components when the dense array changes
+//
+//      Both arrays are paged. Components are stored in fixed size pages that are never reallocated, so growing the pool doesn't invalidate
+//      pointers to live components (only removing a component can move the last one). The sparse array pages are allocated lazily, so
+//      entities with very large indices don't reserve memory for all the indices below them
+//
+//      Each component also has two ticks, when it was added and when it was last changed (when a mutable reference was taken). The pool
+//      tick is set by the scene at the start of each physics iteration, and is used for the Added and Changed view filters
 
 namespace Fresa
 {
     struct ComponentPool {
-        ui8* pool_data{ nullptr };
-        size_t element_size{ 0 };
+        using MoveFunction = void(*)(void* dst, void* src); //: Move constructs dst from src and destroys src
+        using DestroyFunction = void(*)(void* p);
+        using CopyFunction = void(*)(void* dst, const void* src); //: Copy constructs dst from src
+        static constexpr ui32 invalid_index = ui32(-1);
+
+        //: Page sizes (in elements, powers of two)
+        static constexpr ui32 page_shift = 10;
+        static constexpr ui32 page_size = 1 << page_shift;
+        static constexpr ui32 sparse_page_shift = 12;
+        static constexpr ui32 sparse_page_size = 1 << sparse_page_shift;
         
-        ComponentPool(size_t p_size);
+        //: Component pages are aligned to cache lines
+        static constexpr size_t page_alignment = 64;
+
+        //: Sparse array (entity index -> dense index)
+        std::vector<std::unique_ptr<ui32[]>> sparse;
+
+        //: Dense arrays (packed entities and their components)
+        std::vector<EntityID> entities;
+        std::vector<ui8*> pages;
         
+        //: Change detection (dense, same order as the entities)
+        std::vector<ui32> added_ticks;
+        std::vector<ui32> changed_ticks;
+        ui32 tick = 0;
+
+        size_t element_size{ 0 };
+        std::string_view name;
+
+        MoveFunction move_f{ nullptr };
+        DestroyFunction destroy_f{ nullptr };
+        CopyFunction copy_f{ nullptr }; //: Only for copyable components
+
+        ComponentPool(size_t p_size, MoveFunction p_move, DestroyFunction p_destroy);
+        ComponentPool(const ComponentPool &) = delete;
+        ComponentPool &operator=(const ComponentPool &) = delete;
+
         ~ComponentPool();
+
+        template <typename C>
+        static ComponentPool* create() {
+            ComponentPool* pool = new ComponentPool(sizeof(C),
+                                     [](void* dst, void* src){ new (dst) C(std::move(*static_cast<C*>(src))); static_cast<C*>(src)->~C(); },
+                                     [](void* p){ static_cast<C*>(p)->~C(); });
+            pool->name = type_name<C>();
+            if constexpr (std::is_copy_constructible_v<C>)
+                pool->copy_f = [](void* dst, const void* src){ new (dst) C(*static_cast<const C*>(src)); };
+            return pool;
+        }
+
+        //: Returns uninitialized memory for the component of this entity (if it already had one, it is destroyed first)
+        void* add(EntityID eid);
+
+        //: Component of this entity index, or nullptr if it doesn't have one
+        void* get(Entity::EntityIndex index);
+        bool has(Entity::EntityIndex index) const;
+        
+        //: Dense index of this entity index, or invalid_index if it doesn't have one
+        ui32 find(Entity::EntityIndex index) const;
         
-        void* get(size_t index);
+        //: Mark the component as changed in the current tick
+        void setChanged(ui32 dense_index) { changed_ticks[dense_index] = tick; }
+
+        //: Destroys the component and fills the hole with the last one
+        void remove(Entity::EntityIndex index);
+
+        //: Dense access (contiguous inside each page)
+        void* at(size_t dense_index) { return pages[dense_index >> page_shift] + (dense_index & (page_size - 1)) * element_size; }
+        const void* at(size_t dense_index) const { return pages[dense_index >> page_shift] + (dense_index & (page_size - 1)) * element_size; }
+        size_t size() const { return entities.size(); }
+        size_t capacity() const { return pages.size() * page_size; }
+
+        //: Allocates enough pages to hold n components
+        void reserve(size_t n);
+        
+        //: Replaces the contents with a copy of another pool of the same type, reusing the pages that are already allocated
+        void copyFrom(const ComponentPool &other);
+        
+        //: Memory of the live components (with their entity and ticks) and memory allocated by the pool, in bytes
+        size_t bytesUsed() const;
+        size_t bytesReserved() const;
+
+        private:
+            ui32 &sparseAt(Entity::EntityIndex index);
     };
 }
@@ -37,7 +37,7 @@ template<typename Object, UpdatePriorities priority = PRIORITY_LAST> \
 struct update_name { \
     struct exec_register { \
         exec_register() { \
-            addToMultimap(update_map, priority, type_name<Object>(), Object::update_function); \
+            addToMultimap(update_map, priority, type_name<Object>(), Object::update_function, getAccess<Object>()); \
         } \
     }; \
     template<exec_register&> struct ref_it { }; \
@@ -57,27 +57,32 @@ update_name<Object, priority>::register_object;
 //      It is very barebones and should be used only for small projects, something more robust like https://github.com/skypjack/entt is more
 //      appropiate for larger projects. This is meant to be educational only
 
+//: The signature width (maximum number of component types) can be configured defining ECS_MAX_COMPONENTS, a multiple of 64 is recommended
+#ifndef ECS_MAX_COMPONENTS
+#define ECS_MAX_COMPONENTS 64
+#endif
+
 namespace Fresa
 {
-    typedef ui32 EntityID;
-    const EntityID MAX_ENTITIES = 4096;
+    //: There is no limit to the number of entities, the id is made of a 32 bit index and a 32 bit version
+    typedef ui64 EntityID;
 
-    typedef ui8 ComponentID;
-    const ComponentID MAX_COMPONENTS = 32;
+    typedef ui16 ComponentID;
+    const ComponentID MAX_COMPONENTS = ECS_MAX_COMPONENTS;
 
     typedef std::bitset<MAX_COMPONENTS> Signature;
 }
 
 namespace Fresa::Entity
 {
-    typedef ui16 EntityIndex;
-    typedef ui16 EntityVersion;
+    typedef ui32 EntityIndex;
+    typedef ui32 EntityVersion;
 
-    inline EntityID createID(EntityIndex index, EntityVersion version) { return ((EntityID)index << 16) | ((EntityID)version); };
-    inline EntityIndex getIndex(EntityID eid) { return eid >> 16; };
+    inline EntityID createID(EntityIndex index, EntityVersion version) { return ((EntityID)index << 32) | ((EntityID)version); };
+    inline EntityIndex getIndex(EntityID eid) { return (EntityIndex)(eid >> 32); };
     inline EntityVersion getVersion(EntityID eid) { return (EntityVersion)eid; };
 
-    inline bool isValid(EntityID eid) { return (eid >> 16) != EntityIndex(-1); };
+    inline bool isValid(EntityID eid) { return getIndex(eid) != EntityIndex(-1); };
 }
 
 namespace Fresa::Component
@@ -91,6 +96,17 @@ namespace Fresa::Component
         return id_;
     }
     
+    //: Stable hash of the component type name (FNV-1a), it doesn't change with the order of the component list, so it can be saved in files
+    template<typename C>
+    constexpr ui64 getHash() {
+        ui64 hash = 14695981039346656037ull;
+        for (char c : type_name<C>()) {
+            hash ^= (ui8)c;
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+    
     //: Example of looping through components
     //      for_<Component::ComponentType>([](auto i){ using C = std::variant_alternative_t<i.value, Component::ComponentType>; ... });
 }
@@ -113,15 +129,58 @@ namespace Fresa::System
         PRIORITY_TEXT = 18,
     };
     
+    //: Component access
+    //      Systems can declare the components they read and write, so the scheduler can run the ones that don't conflict at the same time
+    //      struct SomeSystem : PhysicsUpdate<SomeSystem, PRIORITY_MOVEMENT> {
+    //          using Reads = System::Components<Velocity>;
+    //          using Writes = System::Components<Position>;
+    //          static void update();
+    //      }
+    //      Systems that don't declare anything are exclusive, they never run at the same time as any other system
+    template <typename... Cs>
+    struct Components {
+        static Signature signature() {
+            Signature s;
+            (s.set(Component::getID<Cs>()), ...);
+            return s;
+        }
+    };
+    
+    struct SystemAccess {
+        Signature reads;
+        Signature writes;
+        bool exclusive = true;
+    };
+    
+    template <typename Object>
+    SystemAccess getAccess() {
+        SystemAccess access{};
+        if constexpr (requires { typename Object::Reads; }) {
+            access.reads = Object::Reads::signature();
+            access.exclusive = false;
+        }
+        if constexpr (requires { typename Object::Writes; }) {
+            access.writes = Object::Writes::signature();
+            access.exclusive = false;
+        }
+        return access;
+    }
+    
     //: Render and physics update systems
-    inline void addToMultimap(std::multimap<UpdatePriorities, std::pair<std::string_view, std::function<void()>>> &map, UpdatePriorities priority,
-                              std::string_view name, std::function<void()> update) {
-        map.insert({ priority, std::pair<std::string_view, std::function<void()>>(name, update) });
+    struct SystemData {
+        std::string_view name;
+        std::function<void()> update;
+        SystemAccess access;
+    };
+    using SystemList = std::multimap<UpdatePriorities, SystemData>;
+    
+    inline void addToMultimap(SystemList &map, UpdatePriorities priority, std::string_view name, std::function<void()> update, SystemAccess access) {
+        map.insert({ priority, SystemData{name, update, access} });
     }
     
-    inline std::multimap<UpdatePriorities, std::pair<std::string_view, std::function<void()>>> init_systems{};
-    inline std::multimap<UpdatePriorities, std::pair<std::string_view, std::function<void()>>> physics_update_systems{};
-    inline std::multimap<UpdatePriorities, std::pair<std::string_view, std::function<void()>>> render_update_systems{};
+    inline SystemList init_systems{};
+    inline SystemList physics_update_systems{};
+    inline SystemList render_update_systems{};
     
     //: Register the system when the template is instantiated, and adds it to the corresponding map of systems
     //      struct SomeSystem : PhysicsUpdate<SomeSystem, PRIORITY_MOVEMENT> {
@@ -3,23 +3,35 @@
 //licensed under GPLv3 uwu
 
 #include "scene.h"
+#include <algorithm>
 
 using namespace Fresa;
 
 EntityID Scene::createEntity(std::string name) {
-    if (not free_entities.empty()) {
-        Entity::EntityIndex new_index = free_entities.front();
-        free_entities.pop_back();
+    if (free_entities.size() > recycle_delay) {
+        Entity::EntityIndex new_index;
+        if (recycle_policy == RECYCLE_LIFO and recycle_delay == 0) {
+            new_index = free_entities.back();
+            free_entities.pop_back();
+        } else {
+            new_index = free_entities.front();
+            free_entities.pop_front();
+        }
         
+        //: The removed entity kept the next version in its slot
         EntityID new_id = Entity::createID(new_index, Entity::getVersion(entities[new_index]));
         entities[new_index] = new_id;
         entity_names[new_index] = name;
+        updateArchetype(new_index);
         return entities[new_index];
     }
     
     entities.push_back(Entity::createID(Entity::EntityIndex(entities.size()), 0));
     mask.push_back(Signature());
     entity_names.push_back(name);
+    entity_archetype.push_back(no_archetype);
+    entity_row.push_back(0);
+    updateArchetype(Entity::EntityIndex(entities.size() - 1));
     return entities.back();
 }
 
@@ -28,34 +40,253 @@ EntityID Scene::createEntity() {
 }
 
 void Scene::removeEntity(EntityID eid) {
-    EntityID new_id = Entity::createID(Entity::EntityIndex(-1), Entity::getVersion(eid) + 1);
-    entities[Entity::getIndex(eid)] = new_id;
+    if (not isValid(eid))
+        return;
+    
+    //: Destroy the components of this entity
+    for (ComponentID cid = 0; cid < component_pools.size(); cid++)
+        if (mask[Entity::getIndex(eid)].test(cid))
+            component_pools[cid]->remove(Entity::getIndex(eid));
+    
+    //: Invalidate the slot, keeping the version for the next entity that uses it
+    Entity::EntityVersion version = Entity::getVersion(eid) + 1;
+    entities[Entity::getIndex(eid)] = Entity::createID(Entity::EntityIndex(-1), version);
     mask[Entity::getIndex(eid)].reset();
-    free_entities.push_back(Entity::getIndex(eid));
+    updateArchetype(Entity::getIndex(eid));
+    
+    //: Retire the slot if it ran out of versions (the last one is reserved for command buffer placeholders)
+    if (version < EntityCommandBuffer::placeholder_version)
+        free_entities.push_back(Entity::getIndex(eid));
 }
 
 void Scene::removeComponent(EntityID eid, ComponentID cid) {
-    if (entities[Entity::getIndex(eid)] != eid)
+    if (not isValid(eid))
         return;
     
+    if (mask[Entity::getIndex(eid)].test(cid))
+        component_pools[cid]->remove(Entity::getIndex(eid));
     mask[Entity::getIndex(eid)].reset(cid);
+    updateArchetype(Entity::getIndex(eid));
 }
 
 str Scene::getName(EntityID eid) {
-    return entity_names.at(Entity::getIndex(eid));
+    //: Snapshots don't copy the names
+    Entity::EntityIndex index = Entity::getIndex(eid);
+    return index < entity_names.size() ? entity_names[index] : "";
 }
 
 Signature Scene::getMask(EntityID eid) {
     return mask.at(Entity::getIndex(eid));
 }
 
-SceneID Fresa::registerScene(str name) {
-    static SceneID id = 0;
-    while (scene_list.find(id) != scene_list.end())
-        id++;
+void Scene::advanceTick() {
+    tick++;
+    for (auto &pool : component_pools)
+        if (pool != nullptr)
+            pool->tick = tick;
+}
+
+void Scene::playbackCommands() {
+    //: Apply the commands recorded by each thread, in thread order
+    for (auto &buffer : command_buffers)
+        buffer.playback(*this);
+}
+
+const std::vector<ui32> &Scene::getArchetypes(Signature signature) {
+    //---Query---
+    //      Returns the archetypes whose signature contains the one requested. The result is cached and archetypes are never removed,
+    //      so only the ones created since the last call need to be checked. Archetypes are not created while systems run (structural
+    //      changes go through command buffers), so queries that are up to date only take the shared lock
+    {
+        std::shared_lock<std::shared_mutex> lock(*query_mutex);
+        auto it = queries.find(signature);
+        if (it != queries.end() and it->second.checked == archetypes.size()) {
+            it->second.calls.fetch_add(1, std::memory_order_relaxed);
+            it->second.hits.fetch_add(1, std::memory_order_relaxed);
+            return it->second.archetypes;
+        }
+    }
+    
+    std::unique_lock<std::shared_mutex> lock(*query_mutex);
+    auto [it, inserted] = queries.try_emplace(signature);
+    Query &query = it->second;
+    query.calls.fetch_add(1, std::memory_order_relaxed);
+    if (not inserted and query.checked == archetypes.size())
+        query.hits.fetch_add(1, std::memory_order_relaxed);
+    for (; query.checked < archetypes.size(); query.checked++) {
+        if ((archetypes[query.checked].signature & signature) == signature)
+            query.archetypes.push_back((ui32)query.checked);
+    }
+    return query.archetypes;
+}
+
+void Scene::updateArchetype(Entity::EntityIndex index) {
+    //---Move entity between archetypes---
+    //      Called after the signature of an entity changes. Removed entities are not part of any archetype
+    ui32 previous = entity_archetype[index];
+    bool alive = Entity::isValid(entities[index]);
+    if (previous != no_archetype and alive and archetypes[previous].signature == mask[index])
+        return;
+    
+    //: Remove from the previous archetype, filling the hole with the last entity
+    if (previous != no_archetype) {
+        std::vector<EntityID> &list = archetypes[previous].entities;
+        ui32 row = entity_row[index];
+        list[row] = list.back();
+        entity_row[Entity::getIndex(list[row])] = row;
+        list.pop_back();
+        entity_archetype[index] = no_archetype;
+    }
+    
+    if (not alive)
+        return;
+    
+    //: Add to the new archetype, creating it if it is the first time this signature is used
+    auto it = archetype_index.find(mask[index]);
+    if (it == archetype_index.end()) {
+        it = archetype_index.insert({mask[index], (ui32)archetypes.size()}).first;
+        archetypes.push_back(Archetype{mask[index], {}});
+    }
+    
+    entity_archetype[index] = it->second;
+    entity_row[index] = (ui32)archetypes[it->second].entities.size();
+    archetypes[it->second].entities.push_back(entities[index]);
+}
+
+SceneStats Scene::getStats() const {
+    SceneStats stats{};
+    stats.entities = entities.size();
+    stats.free = free_entities.size();
+    stats.alive = std::count_if(entities.begin(), entities.end(), [](EntityID e){ return Entity::isValid(e); });
+    stats.archetypes = archetypes.size();
+    
+    //: Free slots below the last live entity
+    size_t end = entities.size();
+    while (end > 0 and not Entity::isValid(entities[end - 1]))
+        end--;
+    stats.free_holes = std::count_if(free_entities.begin(), free_entities.end(), [end](Entity::EntityIndex i){ return i < end; });
+    stats.fragmentation = end > 0 ? (float)stats.free_holes / (float)end : 0.0f;
+    
+    //: Per entity arrays of the scene
+    stats.bytes_used = stats.alive * (sizeof(EntityID) + sizeof(Signature) + 2 * sizeof(ui32));
+    stats.bytes_reserved = entities.capacity() * sizeof(EntityID) + mask.capacity() * sizeof(Signature) +
+                           (entity_archetype.capacity() + entity_row.capacity() + free_entities.size()) * sizeof(ui32) +
+                           entity_names.capacity() * sizeof(str);
     
-    scene_list[id] = Scene{};
-    scene_list[id].name = name;
+    for (ComponentID cid = 0; cid < component_pools.size(); cid++) {
+        const ComponentPool* pool = component_pools[cid].get();
+        if (pool == nullptr)
+            continue;
+        stats.components.push_back(ComponentStats{cid, pool->name, pool->size(), pool->capacity(), pool->element_size,
+                                                  pool->bytesUsed(), pool->bytesReserved()});
+        stats.bytes_used += pool->bytesUsed();
+        stats.bytes_reserved += pool->bytesReserved();
+    }
+    
+    for (auto &[signature, query] : queries) {
+        size_t count = 0;
+        for (ui32 a : query.archetypes)
+            count += archetypes[a].entities.size();
+        stats.queries.push_back(QueryStats{signature, query.archetypes.size(), count, query.calls.load(), query.hits.load()});
+    }
+    
+    return stats;
+}
+
+void Scene::copyFrom(const Scene &source, Signature components) {
+    //---Copy scene---
+    //      Only what views and getComponent read is copied: the entity ids, the masks and the archetypes (with their signatures limited to
+    //      the components, every live entity is kept so a view without components still lists all of them). Names, the free list and the
+    //      archetype rows are only needed to change the scene, so they are left empty. Components that can't be copied are left out
+    for (ComponentID cid = 0; cid < source.component_pools.size(); cid++)
+        if (source.component_pools[cid] != nullptr and source.component_pools[cid]->copy_f == nullptr)
+            components.reset(cid);
+    
+    entities.assign(source.entities.begin(), source.entities.end());
+    entity_names.clear();
+    free_entities.clear();
+    entity_archetype.clear();
+    entity_row.clear();
+    tick = source.tick;
+    name = source.name;
+    
+    mask.resize(source.mask.size());
+    for (size_t i = 0; i < mask.size(); i++)
+        mask[i] = source.mask[i] & components;
+    
+    //: The archetype lists are reused in place, the ones past the copied count keep their memory for the next copy
+    size_t count = 0;
+    for (const Archetype &archetype : source.archetypes) {
+        Signature signature = archetype.signature & components;
+        if (archetype.entities.empty())
+            continue;
+        if (count == archetypes.size())
+            archetypes.emplace_back();
+        archetypes[count].signature = signature;
+        archetypes[count].entities.assign(archetype.entities.begin(), archetype.entities.end());
+        count++;
+    }
+    for (size_t i = count; i < archetypes.size(); i++) {
+        archetypes[i].signature.reset();
+        archetypes[i].entities.clear();
+    }
+    archetype_index.clear();
+    
+    //: The source might be a different scene, so the cached queries are checked again (keeping their memory)
+    for (auto &[signature, query] : queries) {
+        query.archetypes.clear();
+        query.checked = 0;
+    }
+    
+    //: Components
+    if (component_pools.size() < source.component_pools.size())
+        component_pools.resize(source.component_pools.size());
+    for (ComponentID cid = 0; cid < component_pools.size(); cid++) {
+        const ComponentPool* pool = cid < source.component_pools.size() ? source.component_pools[cid].get() : nullptr;
+        if (pool == nullptr or not components.test(cid)) {
+            component_pools[cid].reset();
+            continue;
+        }
+        if (component_pools[cid] == nullptr) {
+            component_pools[cid] = std::make_unique<ComponentPool>(pool->element_size, pool->move_f, pool->destroy_f);
+            component_pools[cid]->copy_f = pool->copy_f;
+            component_pools[cid]->name = pool->name;
+        }
+        component_pools[cid]->copyFrom(*pool);
+    }
+}
+
+SceneID Fresa::registerScene(str name) {
+    Scene scene;
+    scene.name = name;
+    return scene_list.insert(std::move(scene));
+}
+
+void Fresa::removeScene(SceneID id) {
+    scene_list.erase(id);
+    if (id == active_scene)
+        active_scene = SlotMap<Scene>::invalid;
+}
+
+Scene &Fresa::renderScene() {
+    if (render_snapshot != nullptr)
+        return *render_snapshot;
+    return scene_list.at(active_scene);
+}
+
+void Fresa::queueScene(std::unique_ptr<Scene> scene) {
+    //: Replace the scene that was queued before, if it was not swapped yet
+    std::unique_ptr<Scene> previous(queued_scene.exchange(scene.release()));
+}
+
+bool Fresa::swapQueuedScene(bool remove_previous) {
+    std::unique_ptr<Scene> scene(queued_scene.exchange(nullptr));
+    if (scene == nullptr)
+        return false;
     
-    return id;
+    SceneID previous = active_scene;
+    active_scene = scene_list.insert(std::move(scene));
+    if (remove_previous)
+        scene_list.erase(previous);
+    return true;
 }
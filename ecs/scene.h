@@ -6,10 +6,66 @@
 
 #include "ecs.h"
 #include "cpool.h"
+#include "jobs.h"
+#include "command_buffer.h"
+#include "log.h"
+#include "slot_map.h"
 #include <map>
+#include <deque>
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+#include <numeric>
+#include <tuple>
 
 namespace Fresa
 {
+    //---Archetype---
+    //      Group of entities that share the same signature. The scene keeps an index of every signature that has been used, so views can
+    //      visit only the groups that match instead of testing every entity. Components are still stored in their own pools
+    struct Archetype {
+        Signature signature;
+        std::vector<EntityID> entities;
+    };
+    
+    //---Statistics---
+    //      Memory and usage information of a scene, used to size the pools and find wasted capacity. Used bytes count only the live components
+    //      (with their packed entity and ticks), reserved bytes are everything the pool allocated (pages, sparse pages and vectors)
+    //      Fragmentation is the fraction of entity slots below the last live entity that are free, which is what recycling has to fill
+    //      Queries count how many times each view signature was requested and how many times the cached list was already up to date
+    struct ComponentStats {
+        ComponentID id;
+        std::string_view name;
+        size_t count;
+        size_t capacity;
+        size_t element_size;
+        size_t bytes_used;
+        size_t bytes_reserved;
+    };
+    
+    struct QueryStats {
+        Signature signature;
+        size_t archetypes;
+        size_t entities;
+        ui64 calls;
+        ui64 hits;
+        float hitRatio() const { return calls > 0 ? (float)hits / (float)calls : 0.0f; }
+    };
+    
+    struct SceneStats {
+        size_t entities;
+        size_t alive;
+        size_t free;
+        size_t free_holes;
+        float fragmentation;
+        size_t archetypes;
+        size_t bytes_used;
+        size_t bytes_reserved;
+        std::vector<ComponentStats> components;
+        std::vector<QueryStats> queries;
+    };
+    
     //---Scene---
     //      It holds a entities with their signatures (associated components), as well as a component pool allocator.
     //      There are also scene properties, like it's name or size, which are useful to save here. It might be expanded in the future
@@ -21,9 +77,45 @@ namespace Fresa
         std::vector<EntityID> entities;
         std::vector<Signature> mask;
         std::vector<std::string> entity_names;
-        std::vector<Entity::EntityIndex> free_entities;
+        std::deque<Entity::EntityIndex> free_entities;
         
-        std::vector<ComponentPool*> component_pools;
+        //: Entity recycling
+        //      Removed indices go to the free list and are reused with the next version, so the old ids of that slot are no longer valid
+        //      LIFO reuses the most recently freed index (likely still in cache) and FIFO the oldest one. With a recycle delay, an index is
+        //      only reused once that many other indices were freed after it (always in FIFO order), which makes stale ids much less likely
+        //      to match a reused slot. When a slot runs out of versions it is retired and never reused
+        enum RecyclePolicy {
+            RECYCLE_LIFO,
+            RECYCLE_FIFO,
+        };
+        RecyclePolicy recycle_policy = RECYCLE_LIFO;
+        ui32 recycle_delay = 0;
+        
+        std::vector<std::unique_ptr<ComponentPool>> component_pools;
+        
+        //: Archetypes (archetype and row of each entity index)
+        static constexpr ui32 no_archetype = ui32(-1);
+        std::vector<Archetype> archetypes;
+        std::unordered_map<Signature, ui32> archetype_index;
+        std::vector<ui32> entity_archetype;
+        std::vector<ui32> entity_row;
+        
+        //: Cached queries (list of matching archetypes for a signature, only the new archetypes are checked when updating it)
+        //      Views are created from systems running in parallel, so the cache has a shared lock (behind a pointer to keep the scene movable)
+        struct Query {
+            std::vector<ui32> archetypes;
+            size_t checked = 0;
+            std::atomic<ui64> calls = 0;
+            std::atomic<ui64> hits = 0;
+        };
+        std::unordered_map<Signature, Query> queries;
+        std::unique_ptr<std::shared_mutex> query_mutex = std::make_unique<std::shared_mutex>();
+        
+        //: Deferred structural changes, one buffer per thread
+        std::vector<EntityCommandBuffer> command_buffers = std::vector<EntityCommandBuffer>(Jobs::max_threads);
+        
+        //: Change detection tick, advanced at the start of every physics iteration
+        ui32 tick = 1;
         
         //: Scene properties
         str name;
@@ -33,18 +125,25 @@ namespace Fresa
         EntityID createEntity(std::string name);
         void removeEntity(EntityID eid);
         
+        //: True if the id points to a live entity of this scene (the slot exists and has the same version)
+        bool isValid(EntityID eid) const {
+            Entity::EntityIndex index = Entity::getIndex(eid);
+            return index < entities.size() and entities[index] == eid;
+        }
+        
         template<typename C>
         C* addComponent(EntityID eid) {
             int cid = Component::getID<C>();
             
-            if (component_pools.size() <= cid)
-                component_pools.resize(cid + 1, nullptr);
-            if (component_pools[cid] == nullptr)
-                component_pools[cid] = new ComponentPool(sizeof(C));
+            if (not isValid(eid)) {
+                log::error("Adding a component to an entity that doesn't exist");
+                return nullptr;
+            }
             
-            C* component = new (component_pools[cid]->get(Entity::getIndex(eid))) C();
+            C* component = new (createPool<C>()->add(eid)) C();
             
             mask[Entity::getIndex(eid)].set(cid);
+            updateArchetype(Entity::getIndex(eid));
             return component;
         }
         
@@ -52,13 +151,28 @@ namespace Fresa
         C* getComponent(EntityID eid) {
             int cid = Component::getID<C>();
             
-            if (!mask[Entity::getIndex(eid)].test(cid))
+            if (not isValid(eid) or not mask[Entity::getIndex(eid)].test(cid))
                 return nullptr;
             
-            C* component = static_cast<C*>(component_pools[cid]->get(Entity::getIndex(eid)));
+            //: Getting a mutable component marks it as changed
+            ui32 dense = component_pools[cid]->find(Entity::getIndex(eid));
+            component_pools[cid]->setChanged(dense);
+            
+            C* component = static_cast<C*>(component_pools[cid]->at(dense));
             return component;
         }
         
+        //: Read only access, doesn't mark the component as changed
+        template<typename C>
+        const C* readComponent(EntityID eid) {
+            int cid = Component::getID<C>();
+            
+            if (not isValid(eid) or not mask[Entity::getIndex(eid)].test(cid))
+                return nullptr;
+            
+            return static_cast<const C*>(component_pools[cid]->get(Entity::getIndex(eid)));
+        }
+        
         template<typename C>
         void removeComponent(EntityID eid) {
             removeComponent(eid, Component::getID<C>());
@@ -66,88 +180,318 @@ namespace Fresa
         
         void removeComponent(EntityID eid, ComponentID cid);
         
+        //: Pool of this component, created if it doesn't exist
+        template<typename C>
+        ComponentPool* createPool() {
+            int cid = Component::getID<C>();
+            if (component_pools.size() <= cid)
+                component_pools.resize(cid + 1);
+            if (component_pools[cid] == nullptr) {
+                component_pools[cid].reset(ComponentPool::create<C>());
+                component_pools[cid]->tick = tick;
+            }
+            return component_pools[cid].get();
+        }
+        
+        template<typename C>
+        ComponentPool* getPool() {
+            int cid = Component::getID<C>();
+            return component_pools.size() > cid ? component_pools[cid].get() : nullptr;
+        }
+        
         str getName(EntityID eid);
         Signature getMask(EntityID eid);
+        
+        //: Change detection
+        void advanceTick();
+        
+        //: Commands
+        EntityCommandBuffer &commands() { return command_buffers[Jobs::threadIndex()]; }
+        void playbackCommands();
+        
+        //: Archetypes
+        const std::vector<ui32> &getArchetypes(Signature signature);
+        void updateArchetype(Entity::EntityIndex index);
+        
+        //: Statistics
+        SceneStats getStats() const;
+        
+        //: Snapshot
+        //      Turns this scene into a copy of another one with only the components of the signature. The copy is meant to be read only, it
+        //      doesn't have the names, the free list or the archetype index, and only the pools of the components of the signature are copied
+        //      The memory of the previous copy is reused, so copying every frame doesn't allocate once it has grown to the size of the source
+        void copyFrom(const Scene &source, Signature components);
     };
 
+    //---View filters---
+    //      Changed<C> only matches the entities whose component C changed after the tick of the view, and Added<C> the ones where it was added
+    //      They also require the component, which is passed to each like the rest. Components can be const (const C or Changed<const C>),
+    //      then each passes a const reference and they are not marked as changed
+    template <typename C> struct Changed {};
+    template <typename C> struct Added {};
+    
+    enum ViewFilter {
+        FILTER_NONE,
+        FILTER_CHANGED,
+        FILTER_ADDED,
+    };
+    
+    template <typename T> struct view_component { using value = T; static constexpr ViewFilter filter = FILTER_NONE; };
+    template <typename C> struct view_component<Changed<C>> { using value = C; static constexpr ViewFilter filter = FILTER_CHANGED; };
+    template <typename C> struct view_component<Added<C>> { using value = C; static constexpr ViewFilter filter = FILTER_ADDED; };
+    
+    //: Type passed to each (with const) and component type
+    template <typename T> using view_value_t = typename view_component<T>::value;
+    template <typename T> using view_component_t = std::remove_const_t<view_value_t<T>>;
+
     //---Scene view---
     //      Iterable type that can be used to loop over all entities in a scene that match a certain component mask, like:
     //      for (EntityID e : SceneView<Component>(scene)) ...
+    //      It only visits the archetypes that contain all the components, so the cost depends on the number of matching entities.
+    //      An empty component list matches every archetype, so it iterates over all the entities
+    //      You can also get the components directly with each, which for a single component walks the packed pool:
+    //      SceneView<A, B>(scene).each([](A &a, B &b){ ... });
+    //      SceneView<A, B>(scene).each([](EntityID e, A &a, B &b){ ... });
+    //      Filters compare against the tick passed to the view, by default the previous one (so they match the changes of this iteration)
+    //      To get all the changes since a system last run, save the scene tick and pass it to the view the next time:
+    //      SceneView<Changed<Transform>>(scene, last_tick).each(...); last_tick = scene.tick;
     template<typename... ComponentTypes>
     struct SceneView
     {
-        SceneView(Scene &scene) : scene_ptr(&scene) {
-            if (sizeof...(ComponentTypes) == 0) {
-                all = true;
-            }
-            else {
-                ComponentID component_ids[] = { 0, Component::getID<ComponentTypes>() ... };
-                for (int i = 1; i < (sizeof...(ComponentTypes) + 1); i++)
-                    signature.set(component_ids[i]);
+        static constexpr bool has_filters = ((view_component<ComponentTypes>::filter != FILTER_NONE) || ...);
+        
+        SceneView(Scene &scene) : SceneView(scene, scene.tick - 1) {}
+        
+        SceneView(Scene &scene, ui32 p_since) : scene_ptr(&scene), since(p_since) {
+            if constexpr (sizeof...(ComponentTypes) > 0) {
+                ComponentID component_ids[] = { Component::getID<view_component_t<ComponentTypes>>() ... };
+                for (ComponentID cid : component_ids)
+                    signature.set(cid);
             }
+            archetypes = &scene.getArchetypes(signature);
         }
 
         struct Iterator
         {
-            Iterator(Scene* p_scene, Entity::EntityIndex p_index, Signature p_signature, bool p_all) :
-            i_scene(p_scene), i_index(p_index), i_signature(p_signature), i_all(p_all) {}
+            Iterator(const SceneView* p_view, size_t p_archetype) : i_view(p_view), i_archetype(p_archetype) { skip(); }
 
             EntityID operator*() const {
-                return i_scene->entities[i_index];
+                return current().entities[i_row];
             }
         
             bool operator==(const Iterator& other) const {
-                return i_index == other.i_index || i_index == i_scene->entities.size();
+                return i_archetype == other.i_archetype && i_row == other.i_row;
             }
 
             bool operator!=(const Iterator& other) const {
-                return i_index != other.i_index && i_index != i_scene->entities.size();
+                return !(*this == other);
             }
             
-            bool validIndex() {
-                return  Entity::isValid(i_scene->entities[i_index]) &&
-                        (i_all || i_signature == (i_signature & i_scene->mask[i_index]));
+            const Archetype &current() const {
+                return i_view->scene_ptr->archetypes[(*i_view->archetypes)[i_archetype]];
+            }
+            
+            void skip() {
+                while (i_archetype < i_view->archetypes->size()) {
+                    if (i_row >= current().entities.size()) {
+                        i_archetype++;
+                        i_row = 0;
+                        continue;
+                    }
+                    if constexpr (has_filters) {
+                        if (not i_view->passes(Entity::getIndex(current().entities[i_row]))) {
+                            i_row++;
+                            continue;
+                        }
+                    }
+                    break;
+                }
             }
 
             Iterator& operator++() {
-                do {
-                    i_index++;
-                } while (i_index < i_scene->entities.size() && !validIndex());
+                i_row++;
+                skip();
                 return *this;
             }
             
-            Scene* i_scene{ nullptr };
-            Entity::EntityIndex i_index;
-            Signature i_signature;
-            bool i_all{ false };
+            const SceneView* i_view{ nullptr };
+            size_t i_archetype = 0;
+            size_t i_row = 0;
         };
 
         const Iterator begin() const {
-            int first_i = 0;
-            while (first_i < scene_ptr->entities.size() &&
-                  (signature != (signature & scene_ptr->mask[first_i]) ||
-                   !Entity::isValid(scene_ptr->entities[first_i]))) {
-                first_i++;
-            }
-            return Iterator(scene_ptr, first_i, signature, all);
+            return Iterator(this, 0);
         }
         
         const Iterator end() const {
-            return Iterator(scene_ptr, Entity::EntityIndex(scene_ptr->entities.size()), signature, all);
+            return Iterator(this, archetypes->size());
+        }
+        
+        template <typename F>
+        void each(F &&f) {
+            static_assert(sizeof...(ComponentTypes) > 0, "Use a range for loop to iterate over all entities");
+            
+            //: Single component, walk the pool pages directly
+            if constexpr (sizeof...(ComponentTypes) == 1) {
+                ComponentPool* pool = scene_ptr->getPool<view_component_t<ComponentTypes>...>();
+                if (pool != nullptr)
+                    eachDense(f, pool, 0, pool->size());
+            }
+            //: Multiple components, walk the entities of each matching archetype
+            else {
+                ComponentPool* pools[] = { scene_ptr->getPool<view_component_t<ComponentTypes>>()... };
+                for (ui32 a : *archetypes) {
+                    const std::vector<EntityID> &list = scene_ptr->archetypes[a].entities;
+                    eachEntity(f, pools, list.data(), 0, list.size(), std::index_sequence_for<ComponentTypes...>{});
+                }
+            }
+        }
+        
+        //: Parallel version of each, the matching entities are split in chunks that run on the job system
+        //      The results are deterministic as long as the function only writes the components of its own entity. With one component the
+        //      chunks are ranges of the pool aligned to cache lines, so two threads never write to the same line. With more, the chunks are
+        //      ranges of the archetype lists and the components are spread over the pools, so neighbouring chunks can share some lines
+        //      The grain is the minimum number of entities per chunk (0 chooses it based on the number of threads). It waits until all the
+        //      chunks are done
+        //      Don't add or remove entities or components inside the function, it runs at the same time on multiple threads
+        template <typename F>
+        void parallel_each(F &&f, size_t grain = 0) {
+            static_assert(sizeof...(ComponentTypes) > 0, "Use a range for loop to iterate over all entities");
+            Jobs::Counter counter;
+            
+            if constexpr (sizeof...(ComponentTypes) == 1) {
+                using C = view_component_t<std::tuple_element_t<0, std::tuple<ComponentTypes...>>>;
+                ComponentPool* pool = scene_ptr->getPool<C>();
+                if (pool == nullptr)
+                    return;
+                
+                size_t chunk = chunkSize(grain, pool->size(), sizeof(C));
+                for (size_t begin = 0; begin < pool->size(); begin += chunk)
+                    Jobs::submit(counter, [this, &f, pool, begin, chunk](){
+                        eachDense(f, pool, begin, std::min(begin + chunk, pool->size()));
+                    });
+                Jobs::wait(counter);
+            }
+            else {
+                ComponentPool* pools[] = { scene_ptr->getPool<view_component_t<ComponentTypes>>()... };
+                size_t total = 0;
+                for (ui32 a : *archetypes)
+                    total += scene_ptr->archetypes[a].entities.size();
+                
+                size_t chunk = chunkSize(grain, total, sizeof(EntityID));
+                for (ui32 a : *archetypes) {
+                    const std::vector<EntityID> &list = scene_ptr->archetypes[a].entities;
+                    for (size_t begin = 0; begin < list.size(); begin += chunk)
+                        Jobs::submit(counter, [this, &f, &pools, &list, begin, chunk](){
+                            eachEntity(f, pools, list.data(), begin, std::min(begin + chunk, list.size()),
+                                       std::index_sequence_for<ComponentTypes...>{});
+                        });
+                }
+                
+                //: The jobs reference the pools array, wait before it goes out of scope
+                Jobs::wait(counter);
+            }
+        }
+        
+        //: Number of elements per chunk, a multiple of the elements that fit in a cache line (pages are cache line aligned and their size is
+        //  a multiple of any chunk size, so chunks never cross pages)
+        static size_t chunkSize(size_t grain, size_t total, size_t element_size) {
+            size_t step = ComponentPool::page_alignment / std::gcd(element_size, ComponentPool::page_alignment);
+            if (grain == 0)
+                grain = total / (Jobs::threadCount() * 4) + 1;
+            grain = std::min<size_t>(grain, ComponentPool::page_size);
+            return ((grain + step - 1) / step) * step;
+        }
+        
+        //: Check the filters of the view
+        static bool passesFilter(ViewFilter filter, ComponentPool* pool, ui32 dense, ui32 since) {
+            if (filter == FILTER_CHANGED)
+                return pool->changed_ticks[dense] > since;
+            if (filter == FILTER_ADDED)
+                return pool->added_ticks[dense] > since;
+            return true;
+        }
+        
+        bool passes(Entity::EntityIndex index) const {
+            ComponentPool* pools[] = { scene_ptr->getPool<view_component_t<ComponentTypes>>()... };
+            ViewFilter filters[] = { view_component<ComponentTypes>::filter... };
+            for (size_t i = 0; i < sizeof...(ComponentTypes); i++)
+                if (not passesFilter(filters[i], pools[i], pools[i]->find(index), since))
+                    return false;
+            return true;
+        }
+        
+        template <typename F>
+        void eachDense(F &f, ComponentPool* pool, size_t begin, size_t end) {
+            using V = std::tuple_element_t<0, std::tuple<ComponentTypes...>>;
+            using T = view_value_t<V>;
+            while (begin < end) {
+                //: Components are contiguous until the end of the page
+                size_t page_end = std::min<size_t>(end, (begin / ComponentPool::page_size + 1) * ComponentPool::page_size);
+                T* data = static_cast<T*>(pool->at(begin));
+                const EntityID* list = pool->entities.data() + begin;
+                for (size_t i = 0; i < page_end - begin; i++) {
+                    if constexpr (has_filters)
+                        if (not passesFilter(view_component<V>::filter, pool, ui32(begin + i), since))
+                            continue;
+                    if constexpr (not std::is_const_v<T>)
+                        pool->setChanged(ui32(begin + i));
+                    
+                    if constexpr (std::is_invocable_v<F, EntityID, T&>)
+                        f(list[i], data[i]);
+                    else
+                        f(data[i]);
+                }
+                begin = page_end;
+            }
+        }
+        
+        template <typename F, size_t... I>
+        void eachEntity(F &f, ComponentPool** pools, const EntityID* list, size_t begin, size_t end, std::index_sequence<I...>) {
+            ui32 dense[sizeof...(I)];
+            for (size_t i = begin; i < end; i++) {
+                Entity::EntityIndex index = Entity::getIndex(list[i]);
+                ((dense[I] = pools[I]->find(index)), ...);
+                
+                if constexpr (has_filters)
+                    if (not (passesFilter(view_component<ComponentTypes>::filter, pools[I], dense[I], since) && ...))
+                        continue;
+                ((std::is_const_v<view_value_t<ComponentTypes>> ? void() : pools[I]->setChanged(dense[I])), ...);
+                
+                if constexpr (std::is_invocable_v<F, EntityID, view_value_t<ComponentTypes>&...>)
+                    f(list[i], *static_cast<view_value_t<ComponentTypes>*>(pools[I]->at(dense[I]))...);
+                else
+                    f(*static_cast<view_value_t<ComponentTypes>*>(pools[I]->at(dense[I]))...);
+            }
         }
         
         Scene* scene_ptr{ nullptr };
+        const std::vector<ui32>* archetypes{ nullptr };
         Signature signature;
-        bool all{ false };
+        ui32 since = 0;
     };
     
     //---Scene registration---
-    //      Scenes can be created using registerScene(), which adds them to a map that identifies them with an id
-    //      This is a very inefficient allocator, but since the number of scenes should be small relative to everything else,
-    //      it is fine for now. Definitely revisit in the future, maybe to add more functionality to registerScene (serialization)
-    using SceneID = ui32;
-    inline std::map<SceneID, Scene> scene_list;
-    inline SceneID active_scene = 0;
+    //      Scenes are stored in a slot map, so a SceneID is a generational handle with O(1) lookup that stops being valid when the scene is removed
+    //      A scene can also be prepared outside of the list (for example loaded in the background with Serialization::loadSceneAsync) and
+    //      queued with queueScene(). At the start of the next frame it is added to the list and becomes the active scene, so the swap never
+    //      happens while the systems are running. Only one scene can be queued, queueing another one replaces it
+    using SceneID = SlotMap<Scene>::Handle;
+    inline SlotMap<Scene> scene_list;
+    inline SceneID active_scene = SlotMap<Scene>::invalid;
+    inline std::atomic<Scene*> queued_scene = nullptr;
     
     SceneID registerScene(str name);
+    void removeScene(SceneID id);
+    
+    //: Scene transitions (queueScene can be called from any thread, swapQueuedScene is called by the game loop between frames)
+    void queueScene(std::unique_ptr<Scene> scene);
+    bool swapQueuedScene(bool remove_previous = true);
+    
+    //---Render scene---
+    //      Scene that the render systems read. It is the active scene, or a snapshot of it when the render runs at the same time as the
+    //      simulation (Config::pipelined_render). The snapshot only has the components that the render systems read, and changes to it
+    //      are discarded
+    inline std::unique_ptr<Scene> render_snapshot = nullptr;
+    Scene &renderScene();
 }
@@ -0,0 +1,113 @@
+//project fresa, 2017-2022
+//by jose pazos perez
+//licensed under GPLv3 uwu
+
+#include "scheduler.h"
+#include "jobs.h"
+#include "f_time.h"
+
+#include <mutex>
+
+using namespace Fresa;
+
+namespace {
+    struct Node {
+        System::SystemData* system = nullptr;
+        size_t index = 0; //: Position in the system list
+        std::vector<ui32> successors{};
+        ui32 dependencies = 0;
+        std::atomic<ui32> remaining = 0;
+    };
+
+    struct Band {
+        Band(size_t n) : nodes(n) {}
+        std::vector<Node> nodes;
+    };
+
+    struct Graph {
+        std::vector<std::unique_ptr<Band>> bands{};
+        size_t system_count = 0;
+    };
+
+    std::map<const System::SystemList*, Graph> graphs{};
+    std::mutex graphs_mutex; //: Physics and render systems can run at the same time in the pipelined mode
+
+    bool conflict(const System::SystemAccess &a, const System::SystemAccess &b) {
+        if (a.exclusive or b.exclusive)
+            return true;
+        return (a.writes & (b.reads | b.writes)).any() or (b.writes & a.reads).any();
+    }
+
+    Graph &getGraph(System::SystemList &systems) {
+        std::lock_guard<std::mutex> lock(graphs_mutex);
+        Graph &graph = graphs[&systems];
+        if (graph.system_count == systems.size() and not graph.bands.empty())
+            return graph;
+
+        //: Split the list in bands of the same priority
+        graph.bands.clear();
+        graph.system_count = systems.size();
+
+        size_t index = 0;
+        for (auto it = systems.begin(); it != systems.end();) {
+            auto range = systems.equal_range(it->first);
+            auto band = std::make_unique<Band>(std::distance(range.first, range.second));
+
+            ui32 i = 0;
+            for (auto s = range.first; s != range.second; s++, i++) {
+                band->nodes[i].system = &s->second;
+                band->nodes[i].index = index++;
+
+                //: Depend on every previous system of the band that conflicts with this one
+                for (ui32 j = 0; j < i; j++) {
+                    if (conflict(band->nodes[j].system->access, s->second.access)) {
+                        band->nodes[j].successors.push_back(i);
+                        band->nodes[i].dependencies++;
+                    }
+                }
+            }
+
+            graph.bands.push_back(std::move(band));
+            it = range.second;
+        }
+
+        return graph;
+    }
+
+    void runNode(Band &band, ui32 i, std::vector<double> &times, Jobs::Counter &counter) {
+        Node &node = band.nodes[i];
+        TIME(times.at(node.index), node.system->name, node.system->update);
+
+        //: Release the systems that were waiting for this one
+        for (ui32 s : node.successors) {
+            if (band.nodes[s].remaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                Jobs::submit(counter, [&band, s, &times, &counter](){ runNode(band, s, times, counter); });
+        }
+    }
+}
+
+void System::run(SystemList &systems, std::vector<double> &times) {
+    times.resize(systems.size());
+    Graph &graph = getGraph(systems);
+    bool parallel = parallel_systems.load(std::memory_order_relaxed);
+
+    for (auto &band : graph.bands) {
+        //: Sequential (the list order already respects the dependencies)
+        if (not parallel or band->nodes.size() == 1 or Jobs::threadCount() == 1) {
+            for (auto &node : band->nodes)
+                TIME(times.at(node.index), node.system->name, node.system->update);
+            continue;
+        }
+
+        //: Parallel, start with the systems without dependencies and wait for the whole band
+        for (auto &node : band->nodes)
+            node.remaining = node.dependencies;
+
+        Jobs::Counter counter;
+        for (ui32 i = 0; i < band->nodes.size(); i++) {
+            if (band->nodes[i].dependencies == 0)
+                Jobs::submit(counter, [&band = *band, i, &times, &counter](){ runNode(band, i, times, counter); });
+        }
+        Jobs::wait(counter);
+    }
+}
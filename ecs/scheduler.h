@@ -0,0 +1,25 @@
+//project fresa, 2017-2022
+//by jose pazos perez
+//licensed under GPLv3 uwu
+
+#pragma once
+
+#include "ecs.h"
+#include <atomic>
+
+//---Scheduler---
+//      Runs a list of systems using the job system. Systems with the same priority form a band, and inside each band a dependency graph is
+//      built from the components they read and write: a system waits for the previous systems of the band that conflict with it (one writes
+//      what the other reads or writes, or one of them is exclusive). The rest run at the same time. Bands are barriers, a band doesn't start
+//      until the previous one is done, so priorities still define the order
+//      The graph is built the first time a list is run, since systems are registered before the game starts
+
+namespace Fresa::System
+{
+    //: Runs the systems in the list, saving the time each one takes in the vector (same order as the list)
+    void run(SystemList &systems, std::vector<double> &times);
+
+    //: If disabled, systems run one after another on the calling thread (it can be changed from the main thread while the simulation runs,
+    //      each call to run reads it once)
+    inline std::atomic<bool> parallel_systems = true;
+}
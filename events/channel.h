@@ -0,0 +1,41 @@
+//project fresa, 2017-2022
+//by jose pazos perez
+//licensed under GPLv3 uwu
+
+#pragma once
+
+#include "events.h"
+#include "event_queue.h"
+
+//---Channel---
+//      Event that can be published from any thread, but whose handlers always run on the consumer thread. It is an event queue that owns
+//      its event, so it is drained with the rest of the queues at the start of each frame on the main thread
+//      Event::Channel<str> asset_loaded;
+//      Event::Observer o = asset_loaded.createObserver([](const str &name){ ... }); //: Runs on the main thread
+//      asset_loaded.publish("texture.png"); //: From a loader thread
+//      publish never blocks. If the channel is full it returns false and the message is dropped, so producers can retry or slow down
+//      The statistics (sent, received, dropped and the maximum number of pending messages) help to size the capacity
+
+namespace Fresa::Event
+{
+    template <typename... Args>
+    struct Channel : EventQueue<Args...> {
+        using Handler = typename LocalEvent<Args...>::Handler;
+        using Observer = typename LocalEvent<Args...>::Observer;
+
+        //: The queue only keeps a reference to the event, which is constructed after it
+        Channel(size_t capacity = 1024) : EventQueue<Args...>(event, QUEUE_ALL, capacity) {}
+
+        //---Handler management (consumer thread)---
+        Observer createObserver(const Handler &h) const { return event.createObserver(h); }
+        HandlerID callback(const Handler &h) const { return event.callback(h); }
+        void removeCallback(HandlerID id) const { event.removeCallback(id); }
+        size_t observerCount() const { return event.observerCount(); }
+
+        //---Send (any thread)---
+        bool publish(Args... args) { return this->push(std::move(args)...); }
+
+        private:
+            LocalEvent<Args...> event;
+    };
+}
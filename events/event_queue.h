@@ -0,0 +1,121 @@
+//project fresa, 2017-2022
+//by jose pazos perez
+//licensed under GPLv3 uwu
+
+#pragma once
+
+#include "events.h"
+#include "ring_buffer.h"
+
+#include <tuple>
+#include <mutex>
+
+//---Event queue---
+//      Deferred version of an event. Any thread can push events (lock free, without touching the handlers), and they are published on the
+//      main thread in a batch when the queue is drained. All queues are drained by the game loop at the start of each frame, while the
+//      simulation is stopped, so the handlers can touch the game state. Queues can be created and destroyed from any thread
+//      The queue can collapse the events of the batch: QUEUE_LAST only publishes the last one, which is what is needed for things like
+//      mouse movement, where 200 positions in a frame are only useful as the final one
+//      inline Event::EventQueue<Vec2<>> queue_move{event_move, Event::QUEUE_LAST};
+//      queue_move.push(pos); //: From any thread, event_move observers are called later from the main thread
+//      If the queue is full the event is dropped and push returns false, so producers can retry or slow down. The statistics (sent,
+//      received, dropped and the maximum number of pending events) help to size the capacity, which can be set in the constructor
+//      Channels (channel.h) are queues that own their event
+
+namespace Fresa::Event
+{
+    enum QueuePolicy {
+        QUEUE_ALL,
+        QUEUE_LAST,
+    };
+
+    struct QueueStats {
+        size_t sent;
+        size_t received;
+        size_t dropped;
+        size_t peak;
+    };
+
+    //: Type erased queue for draining all of them
+    struct QueueBase {
+        virtual ~QueueBase() {}
+        virtual size_t drain() = 0;
+    };
+
+    inline std::vector<QueueBase*> &queueList() {
+        static std::vector<QueueBase*> queues;
+        return queues;
+    }
+
+    //: Guards the list, it is held while draining (recursive, so handlers can create or destroy queues)
+    inline std::recursive_mutex &queueMutex() {
+        static std::recursive_mutex mutex;
+        return mutex;
+    }
+
+    //: Drains all the queues, from the main thread
+    void drainQueues();
+
+    template <typename... Args>
+    struct EventQueue : QueueBase {
+        EventQueue(LocalEvent<Args...> &p_event, QueuePolicy p_policy = QUEUE_ALL, size_t capacity = 1024) :
+        event(p_event), policy(p_policy), buffer(capacity) {
+            std::lock_guard<std::recursive_mutex> lock(queueMutex());
+            queueList().push_back(this);
+        }
+
+        ~EventQueue() {
+            std::lock_guard<std::recursive_mutex> lock(queueMutex());
+            auto &queues = queueList();
+            queues.erase(std::remove(queues.begin(), queues.end(), this), queues.end());
+        }
+
+        //: Add an event to the queue (any thread), returns false if it is full and the event was dropped
+        bool push(Args... args) {
+            if (not buffer.push(std::tuple<Args...>(std::move(args)...))) {
+                dropped_count.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            sent_count.fetch_add(1, std::memory_order_relaxed);
+
+            //: Keep track of the highest number of pending events
+            size_t pending = buffer.size();
+            size_t current_peak = peak.load(std::memory_order_relaxed);
+            while (pending > current_peak and not peak.compare_exchange_weak(current_peak, pending, std::memory_order_relaxed)) {}
+            return true;
+        }
+
+        //: Publish the queued events to the event handlers (consumer thread), returns how many were taken from the queue
+        //      Only the events that were already queued, the ones pushed by the handlers wait for the next drain
+        size_t drain() override {
+            std::tuple<Args...> value;
+            size_t n = 0;
+            for (size_t pending = buffer.size(); n < pending and buffer.pop(value); n++)
+                if (policy == QUEUE_ALL)
+                    std::apply([this](auto &... a){ event.publish(a...); }, value);
+            if (policy == QUEUE_LAST and n > 0)
+                std::apply([this](auto &... a){ event.publish(a...); }, value);
+            received_count += n;
+            return n;
+        }
+
+        size_t size() const { return buffer.size(); }
+        size_t dropped() const { return dropped_count.load(std::memory_order_relaxed); }
+
+        //: Statistics (consumer thread)
+        QueueStats stats() const {
+            return QueueStats{sent_count.load(std::memory_order_relaxed), received_count,
+                              dropped_count.load(std::memory_order_relaxed), peak.load(std::memory_order_relaxed)};
+        }
+
+        private:
+            LocalEvent<Args...> &event;
+            QueuePolicy policy;
+            RingBuffer<std::tuple<Args...>> buffer;
+
+            std::atomic<size_t> sent_count = 0;
+            std::atomic<size_t> dropped_count = 0;
+            std::atomic<size_t> peak = 0;
+            size_t received_count = 0;
+    };
+}
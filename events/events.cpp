@@ -3,6 +3,7 @@
 //licensed under GPLv3 uwu
 
 #include "events.h"
+#include "event_queue.h"
 
 #include "input.h"
 #include "gui.h"
@@ -14,6 +15,7 @@ using namespace Fresa;
 
 //---Event handling---
 //      Here all the system events are processed with SDL built in event system, and they are translated to fresa's event system
+//      Input is pushed to the input ring, and it is applied and published in the next physics iteration by Input::frame()
 
 #ifndef DISABLE_GUI
     #define CHECK_GUI_USING_KEYBOARD if (not Input::gui_using_keyboard)
@@ -27,33 +29,35 @@ void Event::handleSystemEvents() {
     SDL_Event event;
     while (SDL_PollEvent(&event)) {
         #ifndef DISABLE_GUI
-        ImGui_ImplSDL2_ProcessEvent(&event);
+        if (ImGui::GetCurrentContext() != nullptr) //: No gui in headless mode
+            ImGui_ImplSDL2_ProcessEvent(&event);
         #endif
         
         switch (event.type) {
             case SDL_QUIT: {
                 event_quit.publish();
+                break;
             } case SDL_KEYDOWN: {
                 if (event.key.repeat == 0)
-                    CHECK_GUI_USING_KEYBOARD Input::event_key_down.publish((Input::Key)event.key.keysym.sym);
+                    CHECK_GUI_USING_KEYBOARD Input::push({Input::InputType::KeyDown, (ui32)event.key.keysym.scancode, (Input::Key)event.key.keysym.sym, {}, event.key.timestamp});
                 break;
             } case SDL_KEYUP: {
                 if (event.key.repeat == 0)
-                    CHECK_GUI_USING_KEYBOARD Input::event_key_up.publish((Input::Key)event.key.keysym.sym);
+                    CHECK_GUI_USING_KEYBOARD Input::push({Input::InputType::KeyUp, (ui32)event.key.keysym.scancode, (Input::Key)event.key.keysym.sym, {}, event.key.timestamp});
                 break;
             } case SDL_MOUSEMOTION: {
                 Vec2<> pos{};
                 SDL_GetGlobalMouseState(&pos.x, &pos.y);
-                CHECK_GUI_USING_MOUSE Input::event_mouse_move.publish(pos);
+                CHECK_GUI_USING_MOUSE Input::push({Input::InputType::MouseMove, 0, 0, pos, event.motion.timestamp});
                 break;
             } case SDL_MOUSEBUTTONDOWN: {
-                CHECK_GUI_USING_MOUSE Input::event_mouse_down.publish((Input::MouseButton)event.button.button);
+                CHECK_GUI_USING_MOUSE Input::push({Input::InputType::MouseDown, (ui32)event.button.button, 0, {}, event.button.timestamp});
                 break;
             } case SDL_MOUSEBUTTONUP: {
-                CHECK_GUI_USING_MOUSE Input::event_mouse_up.publish((Input::MouseButton)event.button.button);
+                CHECK_GUI_USING_MOUSE Input::push({Input::InputType::MouseUp, (ui32)event.button.button, 0, {}, event.button.timestamp});
                 break;
             } case SDL_MOUSEWHEEL: {
-                CHECK_GUI_USING_MOUSE Input::event_mouse_wheel.publish(event.wheel.y);
+                CHECK_GUI_USING_MOUSE Input::push({Input::InputType::MouseWheel, 0, 0, Vec2<>(event.wheel.y, 0), event.wheel.timestamp});
                 break;
             } case SDL_WINDOWEVENT: {
                 if (event.window.event == SDL_WINDOWEVENT_FOCUS_LOST)
@@ -71,3 +75,9 @@ void Event::handleSystemEvents() {
         }
     }
 }
+
+void Event::drainQueues() {
+    std::lock_guard<std::recursive_mutex> lock(queueMutex());
+    for (size_t i = 0; i < queueList().size(); i++)
+        queueList()[i]->drain();
+}
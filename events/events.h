@@ -9,11 +9,13 @@
 #include "types.h"
 
 #include <mutex>
+#include <algorithm>
 
 namespace Fresa::Event
 {
     template <typename... Args> struct Event;
     template <typename... Args> struct SharedEvent;
+    template <typename... Args> struct LocalEvent;
     using HandlerID = ui32;
 
     //---Observer---
@@ -42,6 +44,10 @@ namespace Fresa::Event
             data.reset(new typename Event<Args...>::Observer(event.createObserver(handler)));
         }
         
+        template <typename H, typename... Args> void observe(LocalEvent<Args...> &event, const H &handler) {
+            data.reset(new typename LocalEvent<Args...>::Observer(event.createObserver(handler)));
+        }
+        
         //: Stop observing an event
         void reset() { data.reset(); }
         
@@ -190,8 +196,187 @@ namespace Fresa::Event
         }
     };
     
+    //---Local event---
+    //      Single threaded version of Event, for events that are published and observed from the main thread (system events, input, timers...)
+    //      Publishing doesn't lock, allocate or touch any atomic: handlers are stored in place and called by index. Handlers added while
+    //      publishing wait in a separate list until the publish ends, and the ones removed are only marked and erased afterwards
+    //      Observers are linked to the event, so destroying the event detaches them instead of using shared ownership
+    template <typename... Args>
+    struct LocalEvent {
+        //---Handler---
+        using Handler = std::function<void(const Args &...)>;
+        struct Observer;
+        
+        struct StoredHandler {
+            HandlerID id;
+            Handler callback;
+            Observer* observer = nullptr;
+            bool removed = false;
+        };
+        
+        //: Handler data (in its own allocation so observers can point to it while the event is moved)
+        struct Data {
+            HandlerID id_counter = 0;
+            std::vector<StoredHandler> handlers;
+            std::vector<StoredHandler> added;
+            ui32 publishing = 0;
+            bool removed = false;
+            
+            StoredHandler* find(HandlerID id) {
+                for (auto* list : {&handlers, &added})
+                    for (auto &h : *list)
+                        if (h.id == id and not h.removed)
+                            return &h;
+                return nullptr;
+            }
+            
+            void remove(HandlerID id) {
+                StoredHandler* h = find(id);
+                if (h == nullptr)
+                    return;
+                h->removed = true;
+                h->observer = nullptr;
+                removed = true;
+                if (publishing == 0)
+                    compact();
+            }
+            
+            void compact() {
+                if (removed) {
+                    std::erase_if(handlers, [](auto &h){ return h.removed; });
+                    std::erase_if(added, [](auto &h){ return h.removed; });
+                    removed = false;
+                }
+                for (auto &h : added)
+                    handlers.push_back(std::move(h));
+                added.clear();
+            }
+            
+            ~Data() {
+                for (auto* list : {&handlers, &added})
+                    for (auto &h : *list)
+                        if (h.observer != nullptr)
+                            h.observer->data = nullptr;
+            }
+        };
+        std::unique_ptr<Data> data;
+        
+        //: Add a handler to the event
+        HandlerID addHandler(Handler h, Observer* observer = nullptr) const {
+            auto &list = data->publishing > 0 ? data->added : data->handlers;
+            list.push_back(StoredHandler{data->id_counter, std::move(h), observer});
+            return data->id_counter++;
+        }
+        
+        //---Observer---
+        
+        struct Observer : ::Fresa::Event::Observer::Base {
+            //: Event data, set to nullptr by the event if it is destroyed first
+            Data* data = nullptr;
+            HandlerID id = 0;
+            
+            //: Constructors
+            Observer() {}
+            Observer(Data* _data, HandlerID _id) : data(_data), id(_id) { link(); }
+            
+            Observer(Observer &&other) : data(other.data), id(other.id) { other.data = nullptr; link(); }
+            Observer(const Observer &other) = delete;
+            
+            //: Assignment
+            Observer &operator=(const Observer &other) = delete;
+            Observer &operator=(Observer &&other) {
+                reset();
+                data = other.data; id = other.id;
+                other.data = nullptr;
+                link();
+                return *this;
+            }
+            
+            //: Change the observed event (for the same type)
+            void observe(const LocalEvent &event, const Handler &handler) {
+                *this = event.createObserver(handler);
+            }
+            
+            //: Removes the handler from the event
+            void reset() {
+                if (data != nullptr)
+                    data->remove(id);
+                data = nullptr;
+            }
+            
+            //: Destructor
+            ~Observer() { reset(); }
+            
+            private:
+                void link() {
+                    if (data == nullptr)
+                        return;
+                    if (StoredHandler* h = data->find(id))
+                        h->observer = this;
+                }
+        };
+        
+        //: Number of observers associated with the event
+        size_t observerCount() const {
+            return std::count_if(data->handlers.begin(), data->handlers.end(), [](auto &h){ return not h.removed; }) +
+                   std::count_if(data->added.begin(), data->added.end(), [](auto &h){ return not h.removed; });
+        }
+        
+        //---Handler management---
+        
+        //: Creates a new observer and passes a temporary handler to the event
+        Observer createObserver(const Handler &h) const { return Observer(data.get(), addHandler(h)); }
+        
+        //: Creates or removes a permanent handler to the event
+        HandlerID callback(const Handler &h) const { return addHandler(h); }
+        void removeCallback(HandlerID id) const { data->remove(id); }
+        
+        //: Removes all handlers to the event
+        void reset() const {
+            for (auto* list : {&data->handlers, &data->added}) {
+                for (auto &h : *list) {
+                    if (h.observer != nullptr)
+                        h.observer->data = nullptr;
+                    h.observer = nullptr;
+                    h.removed = true;
+                }
+            }
+            data->removed = true;
+            if (data->publishing == 0)
+                data->compact();
+        }
+        
+        //---Emit---
+        //      Calls the handlers connected to the event (in order of addition). It can be called recursively from a handler
+        void publish(Args... args) const {
+            data->publishing++;
+            for (size_t i = 0; i < data->handlers.size(); i++) {
+                if (not data->handlers[i].removed)
+                    data->handlers[i].callback(args...);
+            }
+            if (--data->publishing == 0)
+                data->compact();
+        }
+        
+        //---Constructors---
+        LocalEvent() : data(std::make_unique<Data>()) {}
+        LocalEvent(LocalEvent &&other) : LocalEvent() { *this = std::move(other); }
+        
+        //---Assignment---
+        LocalEvent &operator=(LocalEvent &&other) {
+            std::swap(data, other.data);
+            return *this;
+        }
+        LocalEvent(const LocalEvent &) = delete;
+        LocalEvent &operator=(const LocalEvent &) = delete;
+    };
+    
     //---System events---
     void handleSystemEvents();
-    inline Event<> event_quit;
-    inline Event<bool> event_paused;
+    inline LocalEvent<> event_quit;
+    inline LocalEvent<bool> event_paused;
+    
+    //: Published on the main thread every frame after the physics, when the render can read the simulation state (in the pipelined mode
+    //      it is the only moment when the simulation is not running)
+    inline LocalEvent<> event_sync;
 }
@@ -4,10 +4,11 @@
 
 #pragma once
 
-#include <set>
+#include <bitset>
 
 #include "types.h"
 #include "events.h"
+#include "ring_buffer.h"
 #include "log.h"
 
 namespace Fresa
@@ -15,26 +16,48 @@ namespace Fresa
     namespace Input
     {
         //---Keyboard---
+        //      The state is a bitset indexed by a dense key index, so checking a key is a single bit read without allocations. Characters
+        //      (key codes below 128) use their code and the rest of the keys use their scancode after them, which is part of the key code
+        //      (SDLK_SCANCODE_MASK). This doesn't need the keymap, which SDL only fills when the video is initialized, so it also works in
+        //      headless mode and replays
         using Key = ui32;
+        using Scancode = ui32;
+        constexpr ui32 key_count = 128 + SDL_NUM_SCANCODES;
         
         //: Events
-        inline Event::Event<Key> event_key_down;
-        inline Event::Event<Key> event_key_up;
+        inline Event::LocalEvent<Key> event_key_down;
+        inline Event::LocalEvent<Key> event_key_up;
         
         //: State
         struct KeyboardState {
-            std::set<Key> pressed;
-            std::set<Key> down;
-            std::set<Key> released;
+            std::bitset<key_count> pressed;
+            std::bitset<key_count> down;
+            std::bitset<key_count> released;
         };
         
+        //: Updated by Input::frame() in every physics iteration, so in the pipelined mode the render and the gui can only read the keyboard
+        //      and mouse states from event_sync (or after Game::update waits for the simulation), not while the next frame is simulated
         inline KeyboardState keyboard{};
-        inline KeyboardState keyboard_next{};
+        
+        //: Key index, key_count if it is not valid
+        inline ui32 keyIndex(Key key, Scancode code) {
+            if (key < 128)
+                return key;
+            if (key & SDLK_SCANCODE_MASK)
+                code = key & ~(Key)SDLK_SCANCODE_MASK;
+            return code < SDL_NUM_SCANCODES ? 128 + code : key_count;
+        }
+        //: Other characters (like accented letters) don't have the scancode in the key code, so they are found in the keymap
+        inline ui32 keyIndex(Key key) {
+            if (key < 128 or key & SDLK_SCANCODE_MASK)
+                return keyIndex(key, 0);
+            return keyIndex(key, (Scancode)SDL_GetScancodeFromKey((SDL_Keycode)key));
+        }
         
         //: Functions
-        inline bool key_pressed(Key key) { return keyboard.pressed.count(key); }
-        inline bool key_down(Key key) { return keyboard.down.count(key); }
-        inline bool key_released(Key key) { return keyboard.released.count(key); }
+        inline bool key_pressed(Key key) { ui32 i = keyIndex(key); return i < key_count and keyboard.pressed[i]; }
+        inline bool key_down(Key key) { ui32 i = keyIndex(key); return i < key_count and keyboard.down[i]; }
+        inline bool key_released(Key key) { ui32 i = keyIndex(key); return i < key_count and keyboard.released[i]; }
         
         //---Mouse---
         enum class MouseButton {
@@ -42,69 +65,137 @@ namespace Fresa
             Middle = SDL_BUTTON_MIDDLE,
             Right = SDL_BUTTON_RIGHT,
         };
+        constexpr ui32 mouse_button_count = 8;
         
         //: Events
-        inline Event::Event<Vec2<>> event_mouse_move;
-        inline Event::Event<int> event_mouse_wheel;
-        inline Event::Event<MouseButton> event_mouse_down;
-        inline Event::Event<MouseButton> event_mouse_up;
+        inline Event::LocalEvent<Vec2<>> event_mouse_move;
+        inline Event::LocalEvent<int> event_mouse_wheel;
+        inline Event::LocalEvent<MouseButton> event_mouse_down;
+        inline Event::LocalEvent<MouseButton> event_mouse_up;
         
         //: State
         struct MouseState {
             Vec2<int> position;
             int wheel;
             
-            std::set<MouseButton> pressed;
-            std::set<MouseButton> down;
-            std::set<MouseButton> released;
+            std::bitset<mouse_button_count> pressed;
+            std::bitset<mouse_button_count> down;
+            std::bitset<mouse_button_count> released;
         };
 
         inline MouseState mouse{};
-        inline MouseState mouse_next{};
         
         //: Functions
-        inline bool mouse_pressed(MouseButton button) { return mouse.pressed.count(button); }
-        inline bool mouse_down(MouseButton button) { return mouse.down.count(button); }
-        inline bool mouse_released(MouseButton button) { return mouse.released.count(button); }
+        inline bool mouse_pressed(MouseButton button) { return mouse.pressed[(ui32)button % mouse_button_count]; }
+        inline bool mouse_down(MouseButton button) { return mouse.down[(ui32)button % mouse_button_count]; }
+        inline bool mouse_released(MouseButton button) { return mouse.released[(ui32)button % mouse_button_count]; }
+        
+        //---Input events---
+        //      The system events are pushed to a lock free ring with their timestamp, and each physics iteration Input::frame() takes them out,
+        //      updates the state and publishes the input events. This way the state only changes between iterations, and the input can be
+        //      pushed from any thread (the main thread in the pipelined mode, while the simulation runs in its own)
+        enum class InputType : ui8 {
+            KeyDown,
+            KeyUp,
+            MouseMove,
+            MouseDown,
+            MouseUp,
+            MouseWheel,
+        };
+        
+        struct InputEvent {
+            InputType type;
+            ui32 code; //: Scancode or mouse button
+            Key key; //: Key code, only for keys
+            Vec2<int> value; //: Mouse position or wheel (in x)
+            ui32 timestamp; //: System time in milliseconds
+        };
+        
+        inline RingBuffer<InputEvent> event_ring{1024};
+        inline std::atomic<size_t> dropped_events = 0;
+        
+        //: Events of the current physics iteration, in order
+        inline std::vector<InputEvent> frame_events{};
+        
+        //: Add an event (any thread), it is applied on the next physics iteration
+        inline void push(const InputEvent &event) {
+            if (not event_ring.push(event))
+                dropped_events.fetch_add(1, std::memory_order_relaxed);
+        }
         
         //---Initialization---
         inline void init() {
-            //: Keyboard events
-            event_key_down.callback([](const Key &key){
-                keyboard_next.pressed.insert(key);
-                keyboard_next.down.insert(key);
-            });
-            event_key_up.callback([](const Key &key){
-                keyboard_next.released.insert(key);
-                keyboard_next.down.erase(key);
-            });
-            
-            //: Mouse events
-            event_mouse_move.callback([](const Vec2<> &pos){
-                mouse_next.position = pos;
-            });
-            event_mouse_wheel.callback([](const int &wh){
-                mouse_next.wheel = wh;
-            });
-            event_mouse_down.callback([](const MouseButton &button){
-                mouse_next.pressed.insert(button);
-                mouse_next.down.insert(button);
-            });
-            event_mouse_up.callback([](const MouseButton &button){
-                mouse_next.released.insert(button);
-                mouse_next.down.erase(button);
-            });
+            keyboard = KeyboardState{};
+            mouse = MouseState{};
+            frame_events.clear();
+            frame_events.reserve(event_ring.capacity());
+            InputEvent event;
+            while (event_ring.pop(event)) {}
         }
         
         //---Frame---
+        //      First all the events are applied to the state, so the handlers see the state of the whole iteration, and then they are published
+        //      Mouse movement is only published once with the last position
         inline void frame() {
-            keyboard = keyboard_next;
-            keyboard_next.pressed.clear();
-            keyboard_next.released.clear();
+            keyboard.pressed.reset();
+            keyboard.released.reset();
+            mouse.pressed.reset();
+            mouse.released.reset();
+            
+            frame_events.clear();
+            bool moved = false;
+            for (size_t n = event_ring.size(); n > 0; n--) {
+                InputEvent event;
+                if (not event_ring.pop(event))
+                    break;
+                
+                //: Invalid keys (from a corrupt replay or an unknown key) are dropped
+                ui32 key = keyIndex(event.key, event.code);
+                bool is_key = event.type == InputType::KeyDown or event.type == InputType::KeyUp;
+                if (is_key and key >= key_count)
+                    continue;
+                frame_events.push_back(event);
+                
+                ui32 button = event.code % mouse_button_count;
+                switch (event.type) {
+                    case InputType::KeyDown:
+                        keyboard.pressed.set(key);
+                        keyboard.down.set(key);
+                        break;
+                    case InputType::KeyUp:
+                        keyboard.released.set(key);
+                        keyboard.down.reset(key);
+                        break;
+                    case InputType::MouseMove:
+                        mouse.position = event.value;
+                        moved = true;
+                        break;
+                    case InputType::MouseDown:
+                        mouse.pressed.set(button);
+                        mouse.down.set(button);
+                        break;
+                    case InputType::MouseUp:
+                        mouse.released.set(button);
+                        mouse.down.reset(button);
+                        break;
+                    case InputType::MouseWheel:
+                        mouse.wheel = event.value.x;
+                        break;
+                }
+            }
             
-            mouse = mouse_next;
-            mouse_next.pressed.clear();
-            mouse_next.released.clear();
+            for (auto &event : frame_events) {
+                switch (event.type) {
+                    case InputType::KeyDown: event_key_down.publish(event.key); break;
+                    case InputType::KeyUp: event_key_up.publish(event.key); break;
+                    case InputType::MouseDown: event_mouse_down.publish((MouseButton)event.code); break;
+                    case InputType::MouseUp: event_mouse_up.publish((MouseButton)event.code); break;
+                    case InputType::MouseWheel: event_mouse_wheel.publish(event.value.x); break;
+                    case InputType::MouseMove: break;
+                }
+            }
+            if (moved)
+                event_mouse_move.publish(mouse.position);
         }
         
         //---Key name conversions---
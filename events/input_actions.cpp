@@ -0,0 +1,190 @@
+//project fresa, 2017-2022
+//by jose pazos perez
+//licensed under GPLv3 uwu
+
+#include "input_actions.h"
+#include "serialization.h"
+#include "file.h"
+#include "log.h"
+
+#include <fstream>
+
+using namespace Fresa;
+using namespace Input;
+
+namespace {
+    enum ActionLoadState {
+        LOAD_NONE,
+        LOAD_ACTIONS,
+        LOAD_PLAYER,
+    };
+
+    //: Mouse buttons use their own names, everything else is an SDL key name (unknown keys return key_count and are skipped)
+    std::pair<ui32, bool> resolveBinding(str name, const str &file) {
+        trim(name);
+        if (name == "mouse_left") return {(ui32)MouseButton::Left, true};
+        if (name == "mouse_middle") return {(ui32)MouseButton::Middle, true};
+        if (name == "mouse_right") return {(ui32)MouseButton::Right, true};
+        Key key = Key(SDL_GetKeyFromName(name.c_str()));
+        ui32 index = key == SDLK_UNKNOWN ? key_count : keyIndex(key);
+        if (index >= key_count)
+            log::warn("Unknown key '%s' in the input actions file %s, the binding is skipped", name.c_str(), file.c_str());
+        return {index, false};
+    }
+}
+
+void ActionMap::load(str file) {
+    //: Load file
+    str path = File::path("data/input/" + file);
+    std::ifstream f(path);
+    if (not f.is_open())
+        log::error("Couldn't open the input actions file %s", path.c_str());
+    ActionLoadState state = LOAD_NONE;
+
+    //: The file is read into new lists, which replace the current ones only when all of it is valid, so an error while reloading keeps
+    //      the previous actions working
+    std::vector<str> new_names{};
+    std::vector<bool> new_axis{};
+    std::vector<Binding> new_bindings{};
+    ui32 new_player_count = 0;
+    auto findAction = [&](const str &name) {
+        auto it = std::find(new_names.begin(), new_names.end(), name);
+        if (it == new_names.end())
+            log::error("The input action %s is not defined in %s", name.c_str(), file.c_str());
+        return (ActionID)(it - new_names.begin());
+    };
+
+    //: Line by line
+    std::vector<std::tuple<ui32, ActionID, str>> player_bindings{}; //: Resolved when all the actions are known
+    str s;
+    while (std::getline(f, s)) {
+        //: Indentation
+        int indentation = Serialization::getIndentation(s);
+        if (indentation == -1) continue;
+
+        //: Sections
+        if (indentation == 0) {
+            trim(s);
+            if (s == "actions") {
+                state = LOAD_ACTIONS;
+            } else if (s == "player") {
+                state = LOAD_PLAYER;
+                new_player_count++;
+            } else {
+                log::error("Invalid section in the input actions file %s, it must be 'actions' or 'player'. %s", file.c_str(), s.c_str());
+            }
+            continue;
+        }
+
+        std::vector<str> item = split(s, ":");
+        std::for_each(item.begin(), item.end(), trim);
+
+        //: Action definitions
+        if (state == LOAD_ACTIONS) {
+            if (item.size() > 2 or (item.size() == 2 and item.at(1) != "axis" and item.at(1) != "button"))
+                log::error("Invalid action in %s, it must be 'name' or 'name: axis'. %s", file.c_str(), s.c_str());
+            if (std::find(new_names.begin(), new_names.end(), item.at(0)) != new_names.end())
+                log::error("The action %s is defined twice in %s", item.at(0).c_str(), file.c_str());
+            new_names.push_back(item.at(0));
+            new_axis.push_back(item.size() == 2 and item.at(1) == "axis");
+            continue;
+        }
+
+        //: Player bindings
+        if (state == LOAD_PLAYER) {
+            if (item.size() != 2)
+                log::error("Invalid binding in %s, it must be 'action: key, key...'. %s", file.c_str(), s.c_str());
+            player_bindings.push_back({new_player_count - 1, findAction(item.at(0)), item.at(1)});
+            continue;
+        }
+
+        log::error("The input actions file %s must start with a section ('actions' or 'player')", file.c_str());
+    }
+    ui32 new_action_count = (ui32)new_names.size();
+
+    //: Resolve the key names
+    for (auto &[player, action, list] : player_bindings) {
+        ui32 index = player * new_action_count + action;
+        for (auto &binding : split(list, ",")) {
+            if (not new_axis.at(action)) {
+                auto [code, mouse] = resolveBinding(binding, file);
+                if (mouse or code < key_count)
+                    new_bindings.push_back(Binding{index, code, mouse, 1.0f});
+                continue;
+            }
+            auto sides = split(binding, "/");
+            if (sides.size() != 2)
+                log::error("The binding for the axis %s must be 'negative/positive'. %s", new_names.at(action).c_str(), binding.c_str());
+            for (int i = 0; i < 2; i++) {
+                auto [code, mouse] = resolveBinding(sides.at(i), file);
+                if (mouse or code < key_count)
+                    new_bindings.push_back(Binding{index, code, mouse, i == 0 ? -1.0f : 1.0f});
+            }
+        }
+    }
+
+    //: State buffers for all the players
+    size_t size = (size_t)new_player_count * new_action_count;
+    states = std::vector<ActionState>(size);
+    previous_down = std::vector<ui8>(size);
+
+    //: The events of the actions that are still defined move to their new position, so the observers linked with onPressed and
+    //      onReleased keep working after a reload. Only the events of removed actions or players are destroyed, detaching their observers
+    std::vector<Event::LocalEvent<>> new_pressed(size);
+    std::vector<Event::LocalEvent<>> new_released(size);
+    for (ActionID previous = 0; previous < action_count; previous++) {
+        auto it = std::find(new_names.begin(), new_names.end(), names.at(previous));
+        if (it == new_names.end())
+            continue;
+        ActionID action = (ActionID)(it - new_names.begin());
+        for (ui32 player = 0; player < std::min(player_count, new_player_count); player++) {
+            new_pressed.at(player * new_action_count + action) = std::move(pressed_events.at(player * action_count + previous));
+            new_released.at(player * new_action_count + action) = std::move(released_events.at(player * action_count + previous));
+        }
+    }
+
+    names = std::move(new_names);
+    axis = std::move(new_axis);
+    bindings = std::move(new_bindings);
+    pressed_events = std::move(new_pressed);
+    released_events = std::move(new_released);
+    action_count = new_action_count;
+    player_count = new_player_count;
+}
+
+ActionID ActionMap::id(std::string_view name) const {
+    auto it = std::find(names.begin(), names.end(), name);
+    if (it == names.end())
+        log::error("The input action %s is not defined", str(name).c_str());
+    return (ActionID)(it - names.begin());
+}
+
+void ActionMap::update() {
+    //---Update actions---
+    //      Every binding adds its key to the state of its action. An action is pressed or released if one of its keys was in this iteration,
+    //      or if the action itself changed (so a key that is pressed while another one is held doesn't release it)
+    for (size_t i = 0; i < states.size(); i++) {
+        previous_down[i] = states[i].down;
+        states[i] = ActionState{};
+    }
+
+    for (auto &b : bindings) {
+        bool down = b.mouse ? mouse.down[b.code % mouse_button_count] : keyboard.down[b.code];
+        bool pressed = b.mouse ? mouse.pressed[b.code % mouse_button_count] : keyboard.pressed[b.code];
+        bool released = b.mouse ? mouse.released[b.code % mouse_button_count] : keyboard.released[b.code];
+        ActionState &s = states[b.index];
+        s.value += down ? b.value : 0.0f;
+        s.down |= down;
+        s.pressed |= pressed;
+        s.released |= released;
+    }
+
+    for (size_t i = 0; i < states.size(); i++) {
+        ActionState &s = states[i];
+        s.value = std::clamp(s.value, -1.0f, 1.0f);
+        s.pressed = s.down ? not previous_down[i] : s.pressed;
+        s.released = not s.down and (previous_down[i] or s.released);
+        if (s.pressed) pressed_events[i].publish();
+        if (s.released) released_events[i].publish();
+    }
+}
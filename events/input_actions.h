@@ -0,0 +1,90 @@
+//project fresa, 2017-2022
+//by jose pazos perez
+//licensed under GPLv3 uwu
+
+#pragma once
+
+#include "types.h"
+#include "events.h"
+#include "input.h"
+
+//---Input actions---
+//      Gameplay code asks for actions (jump, move_x...) instead of keys, and the keys bound to them are read from a data file. The names
+//      are resolved once into dense ids, and every physics iteration the bindings are evaluated into a flat buffer with the state of each
+//      action for each player, so checking an action is an array read and adding players doesn't add lookups
+//      data/input/actions.fres:
+//          actions
+//            jump
+//            move_x: axis
+//          player
+//            jump: space, mouse_left
+//            move_x: a/d, left/right
+//          player
+//            jump: return
+//            move_x: j/l
+//      Actions are buttons by default, axis go from -1 to 1 and each binding has the negative and the positive key separated by "/"
+//      Input::actions.load("actions.fres");
+//      ActionID jump = Input::actions.id("jump"); //: Once, when the system is created
+//      if (Input::actions.pressed(jump, player)) ...
+//      The pressed and released events of each action can be linked to state machines:
+//      State::StateEvent<JumpEvent>::link(Input::actions.onPressed(jump), player_state);
+
+namespace Fresa::Input
+{
+    using ActionID = ui32;
+
+    struct ActionState {
+        float value = 0.0f; //: 1 for pressed buttons, from -1 to 1 for axis
+        bool down = false;
+        bool pressed = false;
+        bool released = false;
+    };
+
+    //: The states and the events are updated by the simulation, so in the pipelined mode the render only reads them from event_sync
+    struct ActionMap {
+        //: Reads the actions and the bindings of each player from data/input/, replacing the previous ones. Unknown keys are skipped with a
+        //      warning, and if the file has an error the previous actions are kept
+        void load(str file);
+
+        //: Dense id of an action, resolve it once and keep it
+        ActionID id(std::string_view name) const;
+
+        //: Evaluates the bindings after Input::frame(), it is called by the game loop each physics iteration
+        void update();
+
+        //: Queries
+        const ActionState &state(ActionID action, ui32 player = 0) const { return states[player * action_count + action]; }
+        float value(ActionID action, ui32 player = 0) const { return state(action, player).value; }
+        bool down(ActionID action, ui32 player = 0) const { return state(action, player).down; }
+        bool pressed(ActionID action, ui32 player = 0) const { return state(action, player).pressed; }
+        bool released(ActionID action, ui32 player = 0) const { return state(action, player).released; }
+
+        //: Events, published in update(). They are kept when the file is loaded again, as long as the action and the player still exist
+        const Event::LocalEvent<> &onPressed(ActionID action, ui32 player = 0) const { return pressed_events.at(player * action_count + action); }
+        const Event::LocalEvent<> &onReleased(ActionID action, ui32 player = 0) const { return released_events.at(player * action_count + action); }
+
+        ui32 actionCount() const { return action_count; }
+        ui32 playerCount() const { return player_count; }
+
+        private:
+            //: Bindings of all the players in one array, index is the position of the action state (player * action_count + action)
+            struct Binding {
+                ui32 index;
+                ui32 code; //: Key index or mouse button
+                bool mouse;
+                float value; //: 1 for buttons, -1 or 1 for each side of an axis
+            };
+
+            std::vector<str> names{};
+            std::vector<bool> axis{};
+            std::vector<Binding> bindings{};
+            std::vector<ActionState> states{};
+            std::vector<ui8> previous_down{};
+            std::vector<Event::LocalEvent<>> pressed_events{};
+            std::vector<Event::LocalEvent<>> released_events{};
+            ui32 action_count = 0;
+            ui32 player_count = 0;
+    };
+
+    inline ActionMap actions{};
+}
@@ -0,0 +1,248 @@
+//project fresa, 2017-2022
+//by jose pazos perez
+//licensed under GPLv3 uwu
+
+#include "input_recorder.h"
+#include "config.h"
+#include "f_time.h"
+#include "log.h"
+
+#include <fstream>
+#include <cstring>
+
+using namespace Fresa;
+using namespace Input;
+
+//---File format---
+//      Header: magic "FINP", version, timestep and game speed of the recording, and the input state when it started (keys and mouse
+//      buttons that were down and the mouse position). Then a block for each tick with input: the tick (relative to the start of the
+//      recording), the number of events and the events, 21 bytes each. The last block has no events and marks the length of the recording
+//      Values are written in the byte order of the machine, recordings are not meant to be shared between architectures
+
+namespace {
+    constexpr char magic[4] = {'F', 'I', 'N', 'P'};
+    constexpr ui32 version = 2;
+
+    struct Recording {
+        std::ofstream file;
+        ui64 base_tick = 0;
+        ui32 base_time = 0;
+    };
+    Recording recording{};
+
+    struct Replay {
+        bool active = false;
+        std::vector<std::pair<ui64, InputEvent>> events{};
+        size_t cursor = 0;
+        ui64 base_tick = 0;
+        ui32 base_time = 0;
+        ui64 length = 0;
+        float previous_game_speed = 1.0f;
+        float previous_timestep_override = 0.0f;
+    };
+    Replay replay{};
+
+    template <typename T>
+    void write(std::ofstream &file, const T &value) {
+        file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    template <typename T>
+    bool read(std::ifstream &file, T &value) {
+        return (bool)file.read(reinterpret_cast<char*>(&value), sizeof(T));
+    }
+
+    void writeEvent(std::ofstream &file, const InputEvent &event, ui32 base_time) {
+        write(file, (ui8)event.type);
+        write(file, event.code);
+        write(file, event.key);
+        write(file, event.value.x);
+        write(file, event.value.y);
+        write(file, event.timestamp - base_time);
+    }
+
+    bool readEvent(std::ifstream &file, InputEvent &event) {
+        ui8 type;
+        bool ok = read(file, type) and read(file, event.code) and read(file, event.key) and
+                  read(file, event.value.x) and read(file, event.value.y) and read(file, event.timestamp);
+        event.type = (InputType)type;
+        return ok and type <= (ui8)InputType::MouseWheel and event.code < SDL_NUM_SCANCODES;
+    }
+
+    //: Bitsets are saved as bytes, 8 bits each
+    template <size_t N>
+    void writeBits(std::ofstream &file, const std::bitset<N> &bits) {
+        for (size_t i = 0; i < N; i += 8) {
+            ui8 byte = 0;
+            for (size_t b = 0; b < 8 and i + b < N; b++)
+                byte |= (ui8)bits[i + b] << b;
+            write(file, byte);
+        }
+    }
+
+    template <size_t N>
+    bool readBits(std::ifstream &file, std::bitset<N> &bits) {
+        for (size_t i = 0; i < N; i += 8) {
+            ui8 byte;
+            if (not read(file, byte))
+                return false;
+            for (size_t b = 0; b < 8 and i + b < N; b++)
+                bits[i + b] = (byte >> b) & 1;
+        }
+        return true;
+    }
+}
+
+//---Recording---
+
+bool Input::startRecording(str path) {
+    if (recording.file.is_open())
+        stopRecording();
+
+    recording.file.open(path, std::ios::binary);
+    if (not recording.file.is_open()) {
+        log::warn("Couldn't open the input recording file %s", path.c_str());
+        return false;
+    }
+    recording.base_tick = Time::physics_tick;
+    recording.base_time = SDL_GetTicks();
+
+    write(recording.file, magic);
+    write(recording.file, version);
+    write(recording.file, Config::getTimestep());
+    write(recording.file, Config::game_speed);
+    writeBits(recording.file, keyboard.down);
+    writeBits(recording.file, mouse.down);
+    write(recording.file, mouse.position.x);
+    write(recording.file, mouse.position.y);
+    return true;
+}
+
+void Input::stopRecording() {
+    if (not recording.file.is_open())
+        return;
+    write(recording.file, (ui32)(Time::physics_tick - recording.base_tick));
+    write(recording.file, (ui32)0);
+    recording.file.close();
+}
+
+bool Input::isRecording() {
+    return recording.file.is_open();
+}
+
+void Input::recordFrame() {
+    if (not recording.file.is_open() or frame_events.empty())
+        return;
+
+    //: Only the last mouse movement of the iteration is saved, since the rest are never published
+    size_t last_move = frame_events.size();
+    ui32 count = 0;
+    for (size_t i = 0; i < frame_events.size(); i++) {
+        if (frame_events.at(i).type == InputType::MouseMove) {
+            if (last_move < frame_events.size())
+                count--;
+            last_move = i;
+        }
+        count++;
+    }
+
+    write(recording.file, (ui32)(Time::physics_tick - recording.base_tick));
+    write(recording.file, count);
+    for (size_t i = 0; i < frame_events.size(); i++) {
+        if (frame_events.at(i).type == InputType::MouseMove and i != last_move)
+            continue;
+        writeEvent(recording.file, frame_events.at(i), recording.base_time);
+    }
+}
+
+//---Replay---
+
+bool Input::startReplay(str path) {
+    std::ifstream file(path, std::ios::binary);
+    if (not file.is_open()) {
+        log::warn("Couldn't open the input replay file %s", path.c_str());
+        return false;
+    }
+
+    char file_magic[4];
+    ui32 file_version;
+    float timestep, game_speed;
+    KeyboardState keyboard_start{};
+    MouseState mouse_start{};
+    if (not read(file, file_magic) or std::memcmp(file_magic, magic, 4) != 0 or not read(file, file_version) or file_version != version or
+        not read(file, timestep) or not read(file, game_speed) or not readBits(file, keyboard_start.down) or
+        not readBits(file, mouse_start.down) or not read(file, mouse_start.position.x) or not read(file, mouse_start.position.y)) {
+        log::warn("The input replay file %s is not valid", path.c_str());
+        return false;
+    }
+
+    replay.events.clear();
+    replay.length = 0;
+    ui32 tick, count;
+    while (read(file, tick) and read(file, count)) {
+        replay.length = tick;
+        for (ui32 i = 0; i < count; i++) {
+            InputEvent event;
+            if (not readEvent(file, event)) {
+                log::warn("The input replay file %s is not valid", path.c_str());
+                replay.events.clear();
+                return false;
+            }
+            replay.events.push_back({tick, event});
+        }
+    }
+
+    //: Start from the same state as the recording, with the loop locked to its timestep and game speed until the replay stops
+    if (not replay.active) {
+        replay.previous_game_speed = Config::game_speed;
+        replay.previous_timestep_override = Config::timestep_override;
+    }
+    Input::init();
+    keyboard.down = keyboard_start.down;
+    mouse.down = mouse_start.down;
+    mouse.position = mouse_start.position;
+    Config::game_speed = game_speed;
+    Config::timestep_override = timestep;
+
+    replay.active = true;
+    replay.cursor = 0;
+    replay.base_tick = Time::physics_tick;
+    replay.base_time = SDL_GetTicks();
+    return true;
+}
+
+void Input::stopReplay() {
+    if (replay.active) {
+        Config::game_speed = replay.previous_game_speed;
+        Config::timestep_override = replay.previous_timestep_override;
+    }
+    replay.active = false;
+    replay.events.clear();
+}
+
+bool Input::isReplaying() {
+    return replay.active;
+}
+
+ui64 Input::replayLength() {
+    return replay.length;
+}
+
+void Input::replayFrame() {
+    if (not replay.active)
+        return;
+
+    //: Ignore the input from the system
+    InputEvent discarded;
+    while (event_ring.pop(discarded)) {}
+
+    ui64 tick = Time::physics_tick - replay.base_tick;
+    for (; replay.cursor < replay.events.size() and replay.events.at(replay.cursor).first <= tick; replay.cursor++) {
+        InputEvent event = replay.events.at(replay.cursor).second;
+        event.timestamp += replay.base_time;
+        push(event);
+    }
+
+    if (tick >= replay.length)
+        stopReplay();
+}
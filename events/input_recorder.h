@@ -0,0 +1,38 @@
+//project fresa, 2017-2022
+//by jose pazos perez
+//licensed under GPLv3 uwu
+
+#pragma once
+
+#include "types.h"
+#include "input.h"
+
+//---Input recorder---
+//      Saves the input events of each physics iteration to a binary file, and replays them later in the same physics ticks. Since the
+//      physics run at a fixed timestep, a replay of a session gives the same simulation as long as the game only depends on the input and
+//      the physics ticks (not on the real time), which is useful to compare the performance of the same workload between versions
+//      Input::startRecording("session.input");
+//      ...
+//      Input::stopRecording(); //: Also when the game stops
+//      The replay can run in the game loop or in a headless benchmark (Benchmark::Options::replay), where it runs as fast as possible:
+//      Input::startReplay("session.input");
+//      While replaying, the input from the system is ignored and the loop uses the timestep and game speed of the recording (restored when
+//      it stops). The replay stops by itself after the last recorded tick
+
+namespace Fresa::Input
+{
+    //: Recording
+    bool startRecording(str path);
+    void stopRecording();
+    bool isRecording();
+
+    //: Replay
+    bool startReplay(str path);
+    void stopReplay();
+    bool isReplaying();
+    ui64 replayLength(); //: Physics ticks of the loaded replay
+
+    //: Game loop, before and after Input::frame() in each physics iteration
+    void replayFrame();
+    void recordFrame();
+}
@@ -119,6 +119,11 @@ namespace Fresa::State
         static void link(const Event::Event<Ts...>& e, S& state) {
             e.callback([&](Ts... v){ state.handle(E(v...)); });
         }
+        
+        template <typename S>
+        static void link(const Event::LocalEvent<Ts...>& e, S& state) {
+            e.callback([&](Ts... v){ state.handle(E(v...)); });
+        }
     };
     //-------------------------------------
 
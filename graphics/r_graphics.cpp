@@ -12,6 +12,7 @@
 
 #include "config.h"
 #include "ecs.h"
+#include "scheduler.h"
 #include "gui.h"
 #include "f_time.h"
 
@@ -53,11 +54,7 @@ bool Graphics::update() {
     //---Update---
     
     //: Systems
-    Performance::render_system_time.clear();
-    for (auto &[priority, system] : System::render_update_systems) {
-        Performance::render_system_time.push_back(0);
-        TIME(Performance::render_system_time.back(), system.second);
-    }
+    System::run(System::render_update_systems, Performance::render_system_time);
     
     //: Render
     API::render(api, win, camera);
@@ -19,7 +19,7 @@ namespace Fresa::Graphics
     bool stop();
     
     void onResize(Vec2<> size);
-    inline Event::Event<Vec2<>> event_window_resize;
+    inline Event::LocalEvent<Vec2<>> event_window_resize;
     inline Event::Observer observer = event_window_resize.createObserver(onResize);
     
     template <typename UBO, typename V, typename I, std::enable_if_t<Reflection::is_reflectable<V> && std::is_integral_v<I>, bool> = true>
@@ -0,0 +1,92 @@
+//project fresa, 2017-2022
+//by jose pazos perez
+//licensed under GPLv3
+
+#ifndef DISABLE_GUI
+
+#include "gui.h"
+#include "scene.h"
+#include "reflection.h"
+
+using namespace Fresa;
+
+namespace {
+    str signatureName(Signature signature) {
+        str name = "";
+        for_<Component::ComponentType>([&](auto i){
+            using C = std::variant_alternative_t<i.value, Component::ComponentType>;
+            if (signature.test(i.value))
+                name += (name.empty() ? "" : ", ") + lower(str(type_name<C>()));
+        });
+        return name.empty() ? "all" : name;
+    }
+
+    double kb(size_t bytes) {
+        return (double)bytes / 1024.0;
+    }
+}
+
+void Gui::win_ecs() {
+    if (ImGui::Begin("ecs")) {
+        if (not scene_list.contains(active_scene)) {
+            ImGui::Text("no active scene");
+        } else {
+            SceneStats stats = renderScene().getStats();
+
+            //: Scene
+            ImGui::Text("entities:   %zu (%zu alive, %zu free)", stats.entities, stats.alive, stats.free);
+            ImGui::Text("fragment:   %zu holes (%.1f%%)", stats.free_holes, stats.fragmentation * 100.0f);
+            ImGui::Text("archetypes: %zu", stats.archetypes);
+            ImGui::Text("memory:     %.1f / %.1f kb", kb(stats.bytes_used), kb(stats.bytes_reserved));
+
+            ImGui::Text("");
+
+            static ImGuiTableFlags flags = ImGuiTableFlags_PadOuterX | ImGuiTableFlags_RowBg;
+
+            //: Components
+            if (ImGui::CollapsingHeader("components", ImGuiTreeNodeFlags_DefaultOpen)) {
+                if (ImGui::BeginTable("components", 5, flags)) {
+                    ImGui::TableSetupColumn("component", ImGuiTableColumnFlags_WidthStretch);
+                    ImGui::TableSetupColumn("count");
+                    ImGui::TableSetupColumn("capacity");
+                    ImGui::TableSetupColumn("used kb");
+                    ImGui::TableSetupColumn("reserved kb");
+                    ImGui::TableHeadersRow();
+
+                    for (auto &c : stats.components) {
+                        ImGui::TableNextRow();
+                        ImGui::TableSetColumnIndex(0); ImGui::Text("%s (%zu b)", lower(str(c.name)).c_str(), c.element_size);
+                        ImGui::TableSetColumnIndex(1); ImGui::Text("%zu", c.count);
+                        ImGui::TableSetColumnIndex(2); ImGui::Text("%zu", c.capacity);
+                        ImGui::TableSetColumnIndex(3); ImGui::Text("%.1f", kb(c.bytes_used));
+                        ImGui::TableSetColumnIndex(4); ImGui::Text("%.1f", kb(c.bytes_reserved));
+                    }
+                    ImGui::EndTable();
+                }
+            }
+
+            //: Queries
+            if (ImGui::CollapsingHeader("queries")) {
+                if (ImGui::BeginTable("queries", 4, flags)) {
+                    ImGui::TableSetupColumn("signature", ImGuiTableColumnFlags_WidthStretch);
+                    ImGui::TableSetupColumn("archetypes");
+                    ImGui::TableSetupColumn("entities");
+                    ImGui::TableSetupColumn("hit ratio");
+                    ImGui::TableHeadersRow();
+
+                    for (auto &q : stats.queries) {
+                        ImGui::TableNextRow();
+                        ImGui::TableSetColumnIndex(0); ImGui::Text("%s", signatureName(q.signature).c_str());
+                        ImGui::TableSetColumnIndex(1); ImGui::Text("%zu", q.archetypes);
+                        ImGui::TableSetColumnIndex(2); ImGui::Text("%zu", q.entities);
+                        ImGui::TableSetColumnIndex(3); ImGui::Text("%.1f%% (%llu)", q.hitRatio() * 100.0f, (unsigned long long)q.calls);
+                    }
+                    ImGui::EndTable();
+                }
+            }
+        }
+    }
+    ImGui::End();
+}
+
+#endif
@@ -12,10 +12,10 @@ using namespace Fresa;
 
 void Gui::win_entities() {
     if (ImGui::Begin("entities")) {
-        if (not scene_list.count(active_scene)) {
+        if (not scene_list.contains(active_scene)) {
             ImGui::Text("no active scene");
         } else {
-            Scene &scene = scene_list.at(active_scene);
+            Scene &scene = renderScene(); //: The snapshot in the pipelined mode, where edits are not kept
             
             static ImGuiTableFlags flags = ImGuiTableFlags_PadOuterX | ImGuiTableFlags_RowBg;
             if (ImGui::BeginTable("inspector", 2, flags))
@@ -26,7 +26,7 @@ void Gui::win_entities() {
                 
                 static ui32 n = 0;
                 for (EntityID e : SceneView<>(scene)) {
-                    ImGui::PushID(e);
+                    ImGui::PushID((int)Entity::getIndex(e));
                     ImGui::TableNextRow(); n++;
                     
                     //: Entity
@@ -36,7 +36,7 @@ void Gui::win_entities() {
                     
                     //: Properties
                     ImGui::TableSetColumnIndex(1);
-                    ImGui::Text("id: [%d]", Entity::getIndex(e));
+                    ImGui::Text("id: [%u]", Entity::getIndex(e));
                     
                     //: Submenu
                     if (entity_open) {
@@ -80,16 +80,10 @@ void Gui::init(Graphics::GraphicsAPI &api, const Graphics::WindowData &win) {
     registerWindows();
 }
 
-void Gui::GuiSystem::update() {
+void Gui::GuiSystem::render() {
     //: Delta
-    io->DeltaTime = Config::timestep * Config::game_speed;
+    io->DeltaTime = Config::getTimestep() * Config::game_speed;
     
-    //: Keyboard and mouse
-    Input::gui_using_mouse = io->WantCaptureMouse;
-    Input::gui_using_keyboard = io->WantCaptureKeyboard;
-}
-
-void Gui::GuiSystem::render() {
     #if defined USE_OPENGL
     ImGui_ImplOpenGL3_NewFrame();
     #elif defined USE_VULKAN
@@ -98,6 +92,10 @@ void Gui::GuiSystem::render() {
 
     ImGui_ImplSDL2_NewFrame();
     ImGui::NewFrame();
+    
+    //: Keyboard and mouse
+    Input::gui_using_mouse = io->WantCaptureMouse;
+    Input::gui_using_keyboard = io->WantCaptureKeyboard;
 
     widget_id = 0;
     for (auto &win : windows) {
@@ -34,8 +34,8 @@ namespace Fresa
         //---Gui functions---
         void init(Graphics::GraphicsAPI &api, const Graphics::WindowData &win);
         
-        struct GuiSystem : System::PhysicsUpdate<GuiSystem, System::PRIORITY_GUI>, System::RenderUpdate<GuiSystem, System::PRIORITY_GUI> {
-            static void update();
+        //: Only a render system, so imgui is never touched by the simulation thread in the pipelined mode
+        struct GuiSystem : System::RenderUpdate<GuiSystem, System::PRIORITY_GUI> {
             static void render();
         };
         
@@ -56,11 +56,13 @@ namespace Fresa
         void win_menu();
         void win_performance();
         void win_entities();
+        void win_ecs();
         
         //: Register
         inline void registerWindows() {
             windows.push_back(Window("menu", win_menu, true));
             windows.push_back(Window("entities", win_entities));
+            windows.push_back(Window("ecs", win_ecs));
             windows.push_back(Window("performance", win_performance));
             windows.push_back(Window("test", [](){ImGui::ShowDemoWindow();}));
         }
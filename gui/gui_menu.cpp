@@ -7,6 +7,7 @@
 #include "gui.h"
 #include "config.h"
 #include "scene.h"
+#include "scheduler.h"
 #include "r_graphics.h"
 
 using namespace Fresa;
@@ -36,6 +37,10 @@ void Gui::win_menu() {
             
             ImGui::Checkbox("draw indirect", &Config::draw_indirect);
             
+            bool parallel_systems = System::parallel_systems;
+            if (ImGui::Checkbox("parallel systems", &parallel_systems))
+                System::parallel_systems = parallel_systems;
+            
             //: Attachments
             if (ImGui::BeginMenu("attachments"))
             {
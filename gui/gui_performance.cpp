@@ -7,54 +7,94 @@
 #include "gui.h"
 #include "ecs.h"
 #include "f_time.h"
+#include "histogram.h"
 #include "r_graphics.h"
 
+#include <fstream>
+
 using namespace Fresa;
 
 namespace {
-    std::array<double, 300> fps_points{};
-    std::array<double, 3> fps_averages{};
-    
-    std::array<double, 300> physics_frame_points{};
-    std::array<double, 3> physics_frame_averages{};
-    
-    std::array<double, 300> physics_iteration_points{};
-    std::array<double, 3> physics_iteration_averages{};
+    //---Metrics---
+    //      Every metric records its timings in a histogram. Each second the percentiles of that window are shown, and the window is merged
+    //      into the histogram of the whole run, which can be exported to compare the tail latencies between runs
+    struct Metric {
+        str name;
+        Histogram window{};
+        Histogram total{};
+        std::array<double, 4> shown{}; //: p50, p95, p99 and max of the last window
+        
+        void update() {
+            shown = { window.percentile(50.0), window.percentile(95.0), window.percentile(99.0), window.max() };
+            total.merge(window);
+            window.reset();
+        }
+    };
     
-    std::array<double, 300> physics_event_points{};
-    std::array<double, 3> physics_event_averages{};
+    Metric frame_metric{"frame"};
+    Metric physics_frame_metric{"physics frame"};
+    Metric physics_iteration_metric{"physics iteration"};
+    Metric physics_event_metric{"physics event"};
+    Metric render_frame_metric{"render frame"};
+    Metric render_draw_metric{"render draw"};
     
-    std::array<double, 300> render_frame_points{};
-    std::array<double, 3> render_frame_averages{};
+    std::vector<Metric> physics_systems_metrics{};
+    std::vector<Metric> render_systems_metrics{};
     
-    std::array<double, 300> render_draw_points{};
-    std::array<double, 3> render_draw_averages{};
+    #ifdef USE_VULKAN
+    std::vector<Metric> render_draw_shader_metrics{};
+    #endif
     
-    std::vector<std::array<double, 300>> physics_systems_points{};
-    std::vector<std::array<double, 3>> physics_systems_averages{};
+    //: Physics timings are read when the simulation is not running, one sample for each iteration of the last physics frame
+    //  In the pipelined mode the events are handled once per frame outside of the iterations
+    Event::Observer sync_observer = Event::event_sync.createObserver([](){
+        if (Performance::physics_sample_count == 0)
+            return;
+        physics_frame_metric.window.add(Performance::physics_frame_time);
+        for (size_t s = 0; s < Performance::physics_sample_count; s++) {
+            const auto &sample = Performance::physics_samples.at(s);
+            physics_iteration_metric.window.add(sample.iteration);
+            if (sample.event >= 0.0)
+                physics_event_metric.window.add(sample.event);
+            for (int i = 0; i < sample.systems.size() and i < physics_systems_metrics.size(); i++)
+                physics_systems_metrics.at(i).window.add(sample.systems.at(i));
+        }
+        if (Performance::physics_samples.at(0).event < 0.0)
+            physics_event_metric.window.add(Performance::physics_event_time);
+    });
+    
+    template <typename F>
+    void eachMetric(F f) {
+        for (Metric* m : {&frame_metric, &physics_frame_metric, &physics_iteration_metric, &physics_event_metric, &render_frame_metric, &render_draw_metric})
+            f(*m);
+        for (auto &m : physics_systems_metrics) f(m);
+        for (auto &m : render_systems_metrics) f(m);
+        #ifdef USE_VULKAN
+        for (auto &m : render_draw_shader_metrics) f(m);
+        #endif
+    }
     
-    std::vector<std::array<double, 300>> render_systems_points{};
-    std::vector<std::array<double, 3>> render_systems_averages{};
+    void text(const Metric &m, str name) {
+        ImGui::Text("%s %7.3f  %7.3f  %7.3f  %7.3f", name.c_str(), m.shown.at(0), m.shown.at(1), m.shown.at(2), m.shown.at(3));
+    }
     
-    #ifdef USE_VULKAN
-    std::vector<std::array<double, 300>> render_draw_shader_points{};
-    std::vector<std::array<double, 3>> render_draw_shader_averages{};
-    #endif
-}
-
-double average(std::array<double, 300> &points, int current, int frames) {
-    double avg = 0;
-    for (int i = current - frames; i < current; i++)
-        avg += points.at((i + points.size()) % points.size());
-    return avg / (double)frames;
-}
-
-void updateAverages(std::array<double, 300> &points, std::array<double, 3> &averages, int current) {
-    averages = {
-        average(points, current, 12), //: 0.2s
-        average(points, current, 60), //: 1.0s
-        average(points, current, 300) //: 5.0s
-    };
+    void exportMetrics(str path) {
+        //---Export---
+        //      Csv with the percentiles of the whole run (including the current window) for each metric, in milliseconds
+        std::ofstream file(path);
+        if (not file.is_open()) {
+            log::warn("Couldn't open the performance export file %s", path.c_str());
+            return;
+        }
+        file << "metric,count,mean,min,p50,p90,p95,p99,p99.9,max\n";
+        eachMetric([&file](const Metric &m){
+            Histogram h = m.total;
+            h.merge(m.window);
+            file << m.name << "," << h.size() << "," << h.mean() << "," << h.min() << "," << h.percentile(50.0) << "," << h.percentile(90.0) << ","
+                 << h.percentile(95.0) << "," << h.percentile(99.0) << "," << h.percentile(99.9) << "," << h.max() << "\n";
+        });
+        log::info("Performance histograms exported to %s", path.c_str());
+    }
 }
 
 #ifdef USE_VULKAN
@@ -64,36 +104,30 @@ double timeFromTimestamp(ui64 t1, ui64 t2) {
 #endif
 
 void Gui::win_performance() {
-    static int current = 0;
-    static TimerID timer = setTimer(100);
     static Clock::time_point t = time();
+    static Clock::time_point next_update = t; //: Not a timer, since the simulation can use them from its own thread
     static bool init = false;
     
     if (not init) {
-        physics_systems_points.resize(System::physics_update_systems.size());
-        physics_systems_averages.resize(System::physics_update_systems.size());
-        render_systems_points.resize(System::render_update_systems.size());
-        render_systems_averages.resize(System::render_update_systems.size());
+        for (auto &[priority, system] : System::physics_update_systems)
+            physics_systems_metrics.push_back(Metric{str(system.name)});
+        for (auto &[priority, system] : System::render_update_systems)
+            render_systems_metrics.push_back(Metric{str(system.name)});
         #ifdef USE_VULKAN
-        render_draw_shader_points.resize(Graphics::API::shaders.size());
-        render_draw_shader_averages.resize(Graphics::API::shaders.size());
+        for (auto &[shader, data] : Graphics::API::shaders)
+            render_draw_shader_metrics.push_back(Metric{str(shader)});
         #endif
         init = true;
     }
     
-    fps_points[current] = 1.0 / sec(time() - t);
-    physics_frame_points[current] = Performance::physics_frame_time;
-    physics_iteration_points[current] = Performance::physics_iteration_time;
-    physics_event_points[current] = Performance::physics_event_time;
-    render_frame_points[current] = Performance::render_frame_time;
+    frame_metric.window.add(ms(time() - t));
+    render_frame_metric.window.add(Performance::render_frame_time);
     
-    for (int i = 0; i < Performance::physics_system_time.size(); i++)
-        physics_systems_points.at(i)[current] = Performance::physics_system_time.at(i);
-    for (int i = 0; i < Performance::render_system_time.size(); i++)
-        render_systems_points.at(i)[current] = Performance::render_system_time.at(i);
+    for (int i = 0; i < Performance::render_system_time.size() and i < render_systems_metrics.size(); i++)
+        render_systems_metrics.at(i).window.add(Performance::render_system_time.at(i));
     
     #if defined USE_OPENGL
-    render_draw_points[current] = Performance::render_draw_time;
+    render_draw_metric.window.add(Performance::render_draw_time);
     #elif defined USE_VULKAN
     if (Performance::timestamps.size() == 0) {
         log::warn("GPU Timestamps are not initilized...");
@@ -101,90 +135,80 @@ void Gui::win_performance() {
         ui32 time_points = (ui32)Graphics::API::shaders.size() + 1;
         ui32 swapchain_size = (ui32)Performance::timestamps.size() / (time_points * 2);
         
-        render_draw_points[current] = 0;
+        double draw = 0;
         for (int i = 0; i < swapchain_size; i++)
-            render_draw_points[current] += timeFromTimestamp(Performance::timestamps.at(i * time_points * 2),
-                                                             Performance::timestamps.at(i * time_points * 2 + 1));
-        render_draw_points[current] /= swapchain_size;
+            draw += timeFromTimestamp(Performance::timestamps.at(i * time_points * 2),
+                                      Performance::timestamps.at(i * time_points * 2 + 1));
+        render_draw_metric.window.add(draw / swapchain_size);
         
-        for (int j = 0; j < Graphics::API::shaders.size(); j++) {
-            render_draw_shader_points.at(j)[current] = 0;
+        for (int j = 0; j < render_draw_shader_metrics.size(); j++) {
+            double shader = 0;
             for (int i = 0; i < swapchain_size; i++)
-                render_draw_shader_points.at(j)[current] += timeFromTimestamp(Performance::timestamps.at((i * time_points + j) * 2),
-                                                                              Performance::timestamps.at((i * time_points + j) * 2 + 1));
+                shader += timeFromTimestamp(Performance::timestamps.at((i * time_points + j) * 2),
+                                            Performance::timestamps.at((i * time_points + j) * 2 + 1));
+            render_draw_shader_metrics.at(j).window.add(shader);
         }
     }
     #endif
     
-    current = (current + 1) % 300;
     t = time();
     
-    if (checkTimer(timer)) {
-        timer = setTimer(100);
-        
-        updateAverages(fps_points, fps_averages, current);
-        updateAverages(physics_frame_points, physics_frame_averages, current);
-        updateAverages(physics_iteration_points, physics_iteration_averages, current);
-        updateAverages(physics_event_points, physics_event_averages, current);
-        updateAverages(render_frame_points, render_frame_averages, current);
-        updateAverages(render_draw_points, render_draw_averages, current);
-        
-        for (int i = 0; i < physics_systems_points.size(); i++)
-            updateAverages(physics_systems_points.at(i), physics_systems_averages.at(i), current);
-        for (int i = 0; i < render_systems_points.size(); i++)
-            updateAverages(render_systems_points.at(i), render_systems_averages.at(i), current);
-        
-        #ifdef USE_VULKAN
-        for (int i = 0; i < render_draw_shader_points.size(); i++)
-            updateAverages(render_draw_shader_points.at(i), render_draw_shader_averages.at(i), current);
-        #endif
+    if (t >= next_update) {
+        next_update = t + std::chrono::seconds(1);
+        eachMetric([](Metric &m){ m.update(); });
     }
     
     ImGui::Begin("performance");
     
-    ImGui::Text("fps:    %6.1f   %6.1f   %6.1f", fps_averages.at(0), fps_averages.at(1), fps_averages.at(2));
+    ImGui::Text("fps:    %6.1f", frame_metric.shown.at(0) > 0.0 ? 1.0e3 / frame_metric.shown.at(0) : 0.0);
+    
+    ImGui::Text("");
+    
+    ImGui::Text("            p50      p95      p99      max");
+    text(frame_metric, "frame: ");
     
     ImGui::Text("");
     
     ImGui::Text("physics time");
-    ImGui::Text("frame:  %6.3f   %6.3f   %6.3f", physics_frame_averages.at(0), physics_frame_averages.at(1), physics_frame_averages.at(2));
-    ImGui::Text("iter:   %6.3f   %6.3f   %6.3f", physics_iteration_averages.at(0), physics_iteration_averages.at(1), physics_iteration_averages.at(2));
-    ImGui::Text("event:  %6.3f   %6.3f   %6.3f", physics_event_averages.at(0), physics_event_averages.at(1), physics_event_averages.at(2));
+    text(physics_frame_metric, "frame: ");
+    text(physics_iteration_metric, "iter:  ");
+    text(physics_event_metric, "event: ");
     
     ImGui::Text("");
     
     ImGui::Text("render time");
-    ImGui::Text("frame:  %6.3f   %6.3f   %6.3f", render_frame_averages.at(0), render_frame_averages.at(1), render_frame_averages.at(2));
-    ImGui::Text("draw:   %6.3f   %6.3f   %6.3f", render_draw_averages.at(0), render_draw_averages.at(1), render_draw_averages.at(2));
+    text(render_frame_metric, "frame: ");
+    text(render_draw_metric, "draw:  ");
     
     ImGui::Text("");
     
     if (ImGui::CollapsingHeader("physic systems")) {
-        int i = 0;
-        for (auto &[priority, system] : System::physics_update_systems) {
-            ImGui::Text("%s: %6.3f   %6.3f   %6.3f", str(system.first).c_str(),
-                        physics_systems_averages.at(i).at(0), physics_systems_averages.at(i).at(1), physics_systems_averages.at(i).at(2)); i++;
-        }
+        for (auto &m : physics_systems_metrics)
+            text(m, m.name + ":");
     }
     
     if (ImGui::CollapsingHeader("render systems")) {
-        int i = 0;
-        for (auto &[priority, system] : System::render_update_systems) {
-            ImGui::Text("%s: %6.3f   %6.3f   %6.3f", str(system.first).c_str(),
-                        render_systems_averages.at(i).at(0), render_systems_averages.at(i).at(1), render_systems_averages.at(i).at(2)); i++;
-        }
+        for (auto &m : render_systems_metrics)
+            text(m, m.name + ":");
     }
     
     #ifdef USE_VULKAN
     if (ImGui::CollapsingHeader("gpu timers")) {
-        int i = 0;
-        for (auto &[shader, data] : Graphics::API::shaders) {
-            ImGui::Text("%s: %6.3f   %6.3f   %6.3f", shader.c_str(),
-                        render_draw_shader_averages.at(i).at(0), render_draw_shader_averages.at(i).at(1), render_draw_shader_averages.at(i).at(2)); i++;
-        }
+        for (auto &m : render_draw_shader_metrics)
+            text(m, m.name + ":");
     }
     #endif
     
+    ImGui::Text("");
+    
+    //: Percentiles of the whole run, to compare between versions
+    if (ImGui::Button("export histograms"))
+        exportMetrics("performance_histograms.csv");
+    
+    //: Chrome trace of the next frames, open it in chrome://tracing or https://ui.perfetto.dev
+    if (ImGui::Button("capture 60 frames"))
+        Profiler::capture("profiler_capture.json", 60);
+    
     ImGui::End();
 }
 
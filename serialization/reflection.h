@@ -26,6 +26,7 @@
 #include <numeric>
 #include "variant_helper.h"
 #include "static_str.h"
+#include "string_helper.h"
 
 //---Reflection---
 namespace Fresa
@@ -181,7 +182,7 @@ namespace Fresa
             return s;
         }
         
-        //: Get member index by name (constexpr with string literal or runtime with string)
+        //: Get member index by name (constexpr with string literal or runtime with string, which ignores the case)
         template<Str name, typename T, std::enable_if_t<is_reflectable<T>, bool> = true>
         constexpr size_t get_index_c() {
             constexpr auto it = std::find(T::member_names.begin(), T::member_names.end(), name.sv());
@@ -190,8 +191,8 @@ namespace Fresa
             return index;
         }
         template<typename T, std::enable_if_t<is_reflectable<T>, bool> = true>
-        size_t get_index(str name) {
-            auto it = std::find(T::member_names.begin(), T::member_names.end(), name);
+        size_t get_index(std::string_view name) {
+            auto it = std::find_if(T::member_names.begin(), T::member_names.end(), [name](std::string_view m){ return equals_lower(m, name); });
             size_t index = std::distance(T::member_names.begin(), it);
             if (index == T::member_names.size())
                 throw std::runtime_error("[ ERROR ] You tried to use a name that doesn't belong to any type");
@@ -203,7 +204,7 @@ namespace Fresa
         constexpr auto get_member_i(T* t) {
             constexpr size_t offset = get_offset_c<T, I>();
             using M = std::variant_alternative_t<I, as_type_list<T>>;
-            return (M*)(t + offset);
+            return (M*)((char*)t + offset);
         }
         template<Str name, typename T, std::enable_if_t<is_reflectable<T>, bool> = true>
         constexpr auto get_member(T* t) {
@@ -212,7 +213,7 @@ namespace Fresa
         
         //: Apply a function to a member variable by name (runtime)
         template<typename T, typename F, std::enable_if_t<is_reflectable<T>, bool> = true>
-        auto apply(T* t, str name, F func) {
+        auto apply(T* t, std::string_view name, F func) {
             size_t index = get_index<T>(name);
             for_<as_type_list<T>>([&](auto i){
                 if (i.value == index) {
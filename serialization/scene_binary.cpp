@@ -0,0 +1,295 @@
+//project fresa, 2017-2022
+//by jose pazos perez
+//licensed under GPLv3 uwu
+
+#include "scene_binary.h"
+#include "serialization.h"
+#include "file.h"
+#include "log.h"
+
+#include <fstream>
+#include <cstring>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace Fresa;
+
+//---File format---
+//      [header] [name offsets, ui32 x (entities + 2)] [names] [for each table: entity indices, ui32 x count] [components, 64 byte aligned]
+//      [tables]. The first name is the scene name and the rest are the entity names, name i goes from offset i to offset i + 1
+//      Entity indices point to the position of the entity in the file, since the ids are created again when loading
+
+namespace {
+    constexpr char magic[4] = {'F', 'S', 'C', 'N'};
+    constexpr ui32 version = 1;
+    
+    struct BinaryHeader {
+        char magic[4];
+        ui32 version;
+        ui32 entity_count;
+        ui32 table_count;
+        ui64 names_offset;
+        ui64 tables_offset;
+    };
+    static_assert(sizeof(BinaryHeader) == 32);
+    
+    struct BinaryTable {
+        ui64 hash;
+        ui32 element_size;
+        ui32 count;
+        ui64 entities_offset;
+        ui64 data_offset;
+    };
+    static_assert(sizeof(BinaryTable) == 32);
+    
+    //---Component information---
+    //      Hash, size and pool constructor of every component type, indexed by component id
+    struct ComponentInfo {
+        ui64 hash;
+        ui32 size;
+        bool trivial;
+        std::string_view name;
+        ComponentPool* (*create)(Scene &scene);
+    };
+    
+    const std::vector<ComponentInfo> &componentInfo() {
+        static std::vector<ComponentInfo> info = [](){
+            std::vector<ComponentInfo> v(std::variant_size_v<Component::ComponentType>);
+            for_<Component::ComponentType>([&v](auto i){
+                using C = std::variant_alternative_t<i.value, Component::ComponentType>;
+                v.at(i.value) = ComponentInfo{Component::getHash<C>(), (ui32)sizeof(C), std::is_trivially_copyable_v<C>, type_name<C>(),
+                                              [](Scene &scene){ return scene.createPool<C>(); }};
+            });
+            return v;
+        }();
+        return info;
+    }
+    
+    //---Mapped file---
+    //      Read only memory map of the whole file (on windows it is read into memory instead)
+    struct MappedFile {
+        const ui8* data = nullptr;
+        size_t size = 0;
+        
+        MappedFile(const str &path) {
+            #ifndef _WIN32
+            int fd = open(path.c_str(), O_RDONLY);
+            struct stat st;
+            if (fd < 0 or fstat(fd, &st) != 0) {
+                if (fd >= 0) close(fd);
+                log::error("Couldn't open the binary scene %s", path.c_str());
+            }
+            size = (size_t)st.st_size;
+            if (size > 0) {
+                void* p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+                close(fd);
+                if (p == MAP_FAILED)
+                    log::error("Couldn't map the binary scene %s", path.c_str());
+                data = static_cast<const ui8*>(p);
+            } else {
+                close(fd);
+            }
+            #else
+            std::ifstream f(path, std::ios::binary | std::ios::ate);
+            if (not f.is_open())
+                log::error("Couldn't open the binary scene %s", path.c_str());
+            buffer.resize((size_t)f.tellg());
+            f.seekg(0);
+            f.read(reinterpret_cast<char*>(buffer.data()), buffer.size());
+            data = buffer.data();
+            size = buffer.size();
+            #endif
+        }
+        
+        ~MappedFile() {
+            #ifndef _WIN32
+            if (data != nullptr)
+                munmap(const_cast<ui8*>(data), size);
+            #endif
+        }
+        
+        MappedFile(const MappedFile &) = delete;
+        MappedFile &operator=(const MappedFile &) = delete;
+        
+        //: Checks that a range is inside the file
+        bool contains(ui64 offset, ui64 bytes) const { return offset <= size and bytes <= size - offset; }
+        
+        #ifdef _WIN32
+        std::vector<ui8> buffer;
+        #endif
+    };
+    
+    void append(std::vector<ui8> &out, const void* p, size_t bytes) {
+        out.insert(out.end(), static_cast<const ui8*>(p), static_cast<const ui8*>(p) + bytes);
+    }
+    
+    void align(std::vector<ui8> &out, size_t alignment) {
+        out.resize((out.size() + alignment - 1) / alignment * alignment, 0);
+    }
+}
+
+void Serialization::saveSceneBinary(const Scene &scene, str path) {
+    const auto &info = componentInfo();
+    
+    //: Live entities, in order
+    std::vector<ui32> file_index(scene.entities.size(), ui32(-1));
+    std::vector<Entity::EntityIndex> alive;
+    for (Entity::EntityIndex i = 0; i < scene.entities.size(); i++) {
+        if (not Entity::isValid(scene.entities[i]))
+            continue;
+        file_index[i] = (ui32)alive.size();
+        alive.push_back(i);
+    }
+    
+    std::vector<ui8> out(sizeof(BinaryHeader), 0);
+    BinaryHeader header{{magic[0], magic[1], magic[2], magic[3]}, version, (ui32)alive.size(), 0, 0, 0};
+    
+    //: Names
+    header.names_offset = out.size();
+    std::vector<ui32> offsets{0, (ui32)scene.name.size()};
+    for (auto i : alive)
+        offsets.push_back(offsets.back() + (ui32)scene.entity_names[i].size());
+    append(out, offsets.data(), offsets.size() * sizeof(ui32));
+    append(out, scene.name.data(), scene.name.size());
+    for (auto i : alive)
+        append(out, scene.entity_names[i].data(), scene.entity_names[i].size());
+    
+    //: Component tables
+    std::vector<BinaryTable> tables;
+    for (ComponentID cid = 0; cid < scene.component_pools.size(); cid++) {
+        const ComponentPool* pool = scene.component_pools[cid].get();
+        if (pool == nullptr or pool->size() == 0)
+            continue;
+        if (not info.at(cid).trivial) {
+            log::warn("The component %s is not trivially copyable, it can't be saved in a binary scene", str(info.at(cid).name).c_str());
+            continue;
+        }
+        
+        BinaryTable table{info.at(cid).hash, info.at(cid).size, (ui32)pool->size(), 0, 0};
+        
+        align(out, alignof(ui32));
+        table.entities_offset = out.size();
+        for (EntityID eid : pool->entities) {
+            ui32 index = file_index[Entity::getIndex(eid)];
+            append(out, &index, sizeof(ui32));
+        }
+        
+        align(out, ComponentPool::page_alignment);
+        table.data_offset = out.size();
+        for (size_t begin = 0; begin < pool->size(); begin += ComponentPool::page_size) {
+            size_t count = std::min<size_t>(ComponentPool::page_size, pool->size() - begin);
+            append(out, pool->at(begin), count * pool->element_size);
+        }
+        
+        tables.push_back(table);
+    }
+    
+    align(out, alignof(BinaryTable));
+    header.table_count = (ui32)tables.size();
+    header.tables_offset = out.size();
+    append(out, tables.data(), tables.size() * sizeof(BinaryTable));
+    std::memcpy(out.data(), &header, sizeof(BinaryHeader));
+    
+    std::ofstream f(path, std::ios::binary);
+    if (not f.is_open())
+        log::error("Couldn't open the file %s to save the binary scene", path.c_str());
+    f.write(reinterpret_cast<const char*>(out.data()), out.size());
+}
+
+SceneID Serialization::loadSceneBinary(str file) {
+    SceneID scene_id = registerScene("");
+    loadSceneBinary(file, scene_list.at(scene_id));
+    return scene_id;
+}
+
+void Serialization::loadSceneBinary(str file, Scene &scene) {
+    const auto &info = componentInfo();
+    
+    //: Map file
+    str path = File::path("data/scenes/" + file);
+    MappedFile m(path);
+    
+    //: Header
+    BinaryHeader header;
+    if (not m.contains(0, sizeof(BinaryHeader)))
+        log::error("The binary scene %s is not valid", file.c_str());
+    std::memcpy(&header, m.data, sizeof(BinaryHeader));
+    if (std::memcmp(header.magic, magic, 4) != 0)
+        log::error("The file %s is not a binary scene", file.c_str());
+    if (header.version != version)
+        log::error("The binary scene %s has version %d, but the current one is %d, convert it again", file.c_str(), header.version, version);
+    
+    //: Names
+    ui64 names_size = ((ui64)header.entity_count + 2) * sizeof(ui32);
+    if (not m.contains(header.names_offset, names_size) or header.names_offset % alignof(ui32) != 0 or
+        not m.contains(header.tables_offset, (ui64)header.table_count * sizeof(BinaryTable)) or header.tables_offset % alignof(BinaryTable) != 0)
+        log::error("The binary scene %s is not valid", file.c_str());
+    const ui32* offsets = reinterpret_cast<const ui32*>(m.data + header.names_offset);
+    const char* names = reinterpret_cast<const char*>(m.data + header.names_offset + names_size);
+    if (not m.contains(header.names_offset + names_size, offsets[header.entity_count + 1]))
+        log::error("The binary scene %s is not valid", file.c_str());
+    auto name = [&](ui32 i){
+        if (offsets[i + 1] < offsets[i])
+            log::error("The binary scene %s is not valid", file.c_str());
+        return str(names + offsets[i], offsets[i + 1] - offsets[i]);
+    };
+    
+    scene.name = name(0);
+    
+    //: Entities
+    size_t total = scene.entities.size() + header.entity_count;
+    scene.entities.reserve(total);
+    scene.mask.reserve(total);
+    scene.entity_names.reserve(total);
+    scene.entity_archetype.reserve(total);
+    scene.entity_row.reserve(total);
+    
+    std::vector<EntityID> ids(header.entity_count);
+    for (ui32 i = 0; i < header.entity_count; i++)
+        ids[i] = scene.createEntity(name(i + 1));
+    
+    //: Components, copied directly into the pools
+    const BinaryTable* tables = reinterpret_cast<const BinaryTable*>(m.data + header.tables_offset);
+    for (ui32 t = 0; t < header.table_count; t++) {
+        const BinaryTable &table = tables[t];
+        auto it = std::find_if(info.begin(), info.end(), [&table](const ComponentInfo &c){ return c.hash == table.hash; });
+        if (it == info.end()) {
+            log::warn("The binary scene %s has a component that doesn't exist anymore, skipping it", file.c_str());
+            continue;
+        }
+        if (it->size != table.element_size)
+            log::error("The component %s of the binary scene %s has changed, convert it again", str(it->name).c_str(), file.c_str());
+        if (not m.contains(table.entities_offset, (ui64)table.count * sizeof(ui32)) or table.entities_offset % alignof(ui32) != 0 or
+            not m.contains(table.data_offset, (ui64)table.count * table.element_size))
+            log::error("The binary scene %s is not valid", file.c_str());
+        
+        ComponentID cid = (ComponentID)(it - info.begin());
+        ComponentPool* pool = it->create(scene);
+        pool->reserve(pool->size() + table.count);
+        
+        const ui32* entities = reinterpret_cast<const ui32*>(m.data + table.entities_offset);
+        const ui8* data = m.data + table.data_offset;
+        for (ui32 i = 0; i < table.count; i++) {
+            if (entities[i] >= header.entity_count)
+                log::error("The binary scene %s is not valid", file.c_str());
+            EntityID eid = ids[entities[i]];
+            std::memcpy(pool->add(eid), data + (size_t)i * table.element_size, table.element_size);
+            scene.mask[Entity::getIndex(eid)].set(cid);
+        }
+    }
+    
+    //: Archetypes, once per entity with all of its components
+    for (EntityID eid : ids)
+        scene.updateArchetype(Entity::getIndex(eid));
+}
+
+void Serialization::convertScene(str file, str binary_file) {
+    Scene scene;
+    loadScene(file, scene);
+    saveSceneBinary(scene, File::path("data/scenes/") + binary_file);
+}
@@ -0,0 +1,31 @@
+//project fresa, 2017-2022
+//by jose pazos perez
+//licensed under GPLv3 uwu
+
+#pragma once
+
+#include "scene.h"
+
+//---Binary scenes---
+//      Compiled version of the text scenes, that loads without parsing. The file has a versioned header, the entity names, and a table for
+//      each component type, identified by the hash of its name (Component::getHash) and its size, with the entities that have it and the
+//      components one after the other as raw bytes. The file is memory mapped and the components are copied directly into the pools
+//      Only trivially copyable components can be saved like this, the rest are skipped with a warning (they can be added after loading)
+//      The binary files are made offline from the text ones, with convertScene or from the game executable (see Benchmark::command):
+//      game --convert-scene level.fres //: data/scenes/level.fres -> data/scenes/level.fres.bin
+//      SceneID scene = Serialization::loadSceneBinary("level.fres.bin");
+//      Binary scenes are not portable between architectures (the components are saved with the byte order and layout of the machine), and
+//      have to be converted again when a component changes (loading fails if the size of a component is different)
+
+namespace Fresa::Serialization
+{
+    //: Saves a scene in the binary format (the path is not relative to the resource folder)
+    void saveSceneBinary(const Scene &scene, str path);
+
+    //: Loads a binary scene from data/scenes/, registering it in the scene list or into a scene that is not registered
+    SceneID loadSceneBinary(str file);
+    void loadSceneBinary(str file, Scene &scene);
+
+    //: Converts a text scene from data/scenes/ into a binary scene in the same folder
+    void convertScene(str file, str binary_file);
+}
@@ -6,21 +6,130 @@
 #include "file.h"
 #include "log.h"
 #include <fstream>
+#include <future>
+#include <bit>
 
 using namespace Fresa;
 
-int Serialization::getIndentation(const str &line) {
+namespace {
+    //---Component names---
+    //      Perfect hash of the component names (case insensitive) to their position in Component::ComponentType, built at compile time
+    //      Names are split into buckets with one hash, and each bucket gets the first seed that puts all of its names in free slots of the
+    //      table, so finding a component is two hashes and one comparison, without allocating or going through every type
+    template <typename V>
+    struct ComponentNames;
+    
+    template <typename... Cs>
+    struct ComponentNames<std::variant<Cs...>> {
+        static constexpr size_t count = sizeof...(Cs);
+        static constexpr size_t buckets = std::bit_ceil(count);
+        static constexpr size_t size = std::bit_ceil(count * 2);
+        static constexpr ui32 max_seed = 1 << 16;
+        static constexpr std::array<std::string_view, count> names{ type_name<Cs>()... };
+        
+        static constexpr ui64 hash(std::string_view s, ui64 seed) {
+            ui64 h = 14695981039346656037ull ^ (seed * 0x9E3779B97F4A7C15ull);
+            for (char c : s) {
+                h ^= (ui8)lower_char(c);
+                h *= 1099511628211ull;
+            }
+            return h ^ (h >> 32);
+        }
+        
+        struct Table {
+            std::array<ui32, buckets> seeds{};
+            std::array<ui32, size> slots{}; //: Component index + 1, 0 is empty
+            bool valid = true;
+        };
+        
+        static constexpr Table table = [](){
+            Table t{};
+            std::array<size_t, count> bucket{};
+            std::array<size_t, buckets> bucket_size{};
+            for (size_t i = 0; i < count; i++) {
+                bucket[i] = hash(names[i], 0) & (buckets - 1);
+                bucket_size[bucket[i]]++;
+            }
+            
+            //: Biggest buckets first, they are the hardest to place
+            for (size_t n = count; n > 0; n--) {
+                for (size_t b = 0; b < buckets; b++) {
+                    if (bucket_size[b] != n)
+                        continue;
+                    ui32 seed = 1;
+                    for (; seed < max_seed; seed++) {
+                        std::array<ui32, size> slots = t.slots;
+                        bool fits = true;
+                        for (size_t i = 0; i < count and fits; i++) {
+                            if (bucket[i] != b)
+                                continue;
+                            size_t slot = hash(names[i], seed) & (size - 1);
+                            fits = slots[slot] == 0;
+                            slots[slot] = (ui32)i + 1;
+                        }
+                        if (fits) {
+                            t.slots = slots;
+                            break;
+                        }
+                    }
+                    t.seeds[b] = seed;
+                    t.valid = t.valid and seed < max_seed;
+                }
+            }
+            return t;
+        }();
+        static_assert(table.valid, "Two components have the same name (without case), they can't be loaded from a scene");
+        
+        //: Index of the component in Component::ComponentType, or -1 if there is none with that name
+        static constexpr int find(std::string_view name) {
+            ui32 seed = table.seeds[hash(name, 0) & (buckets - 1)];
+            ui32 slot = table.slots[hash(name, seed) & (size - 1)];
+            return (slot != 0 and equals_lower(names[slot - 1], name)) ? (int)slot - 1 : -1;
+        }
+        
+        //: Functions for each component type, indexed like the names
+        using AddFunction = void (*)(Scene &scene, EntityID eid);
+        using AssignFunction = void (*)(Scene &scene, EntityID eid, std::string_view member, std::string_view value);
+        static constexpr std::array<AddFunction, count> add{ [](Scene &scene, EntityID eid){ scene.addComponent<Cs>(eid); }... };
+        static constexpr std::array<AssignFunction, count> assign{ [](Scene &scene, EntityID eid, std::string_view member, std::string_view value){
+            Reflection::apply(scene.getComponent<Cs>(eid), member, [value](auto *c){ Serialization::assignFromString(*c, value); });
+        }... };
+    };
+    using Components = ComponentNames<Component::ComponentType>;
+    
+    //: Reads the whole file at once, the loaders go through it with views
+    str readFile(const str &path) {
+        str buffer;
+        std::ifstream f(path, std::ios::binary | std::ios::ate);
+        if (not f.is_open())
+            return buffer;
+        buffer.resize((size_t)f.tellg());
+        f.seekg(0);
+        f.read(buffer.data(), buffer.size());
+        return buffer;
+    }
+    
+    //: Next line of the buffer, without the line ending
+    bool nextLine(Tokenizer &lines, std::string_view &line) {
+        if (not lines.next(line))
+            return false;
+        if (not line.empty() and line.back() == '\r')
+            line.remove_suffix(1);
+        return true;
+    }
+}
+
+int Serialization::getIndentation(std::string_view line) {
     size_t indentation = line.find_first_not_of(" ");
-    indentation = indentation == std::string::npos ? 0 : indentation / 2;
     
-    if (line.size() <= indentation * 2) return -1; //: Blank line
+    if (indentation == std::string_view::npos or trimmed(line).empty()) return -1; //: Blank line
     if (line.at(indentation) == '#') return -1; //: Comment
     
-    return (int)indentation;
+    return (int)indentation / 2;
 }
 
-void Serialization::loadComponents(const str &line, LoadState &state, SceneID scene, EntityID eid, int ind, int base_ind, bool add_components) {
-    static str current_component = "";
+void Serialization::loadComponents(std::string_view line, LoadState &state, Scene &scene, EntityID eid, int ind, int base_ind, bool add_components) {
+    thread_local int current_component = -1; //: Scenes can be loaded in the background
     
     if (state == LOAD_COMPONENT_NAME or state == LOAD_COMPONENT_BODY) {
         state = (ind == base_ind) ? LOAD_COMPONENT_NAME : LOAD_COMPONENT_BODY;
@@ -28,69 +137,51 @@ void Serialization::loadComponents(const str &line, LoadState &state, SceneID sc
     
     //: Load component members
     if (state == LOAD_COMPONENT_BODY) {
-        std::vector<str> item = split(line, ":");
-        if (item.size() != 2) log::error("Incorrect formatting on %s", line.c_str());
-        str item_name = lower(item.at(0).substr(ind * 2));
-        str item_value = item.at(1).substr(1);
-        bool component_found = false;
+        size_t separator = line.find(":");
+        if (separator == std::string_view::npos or current_component == -1) log::error("Incorrect formatting on %s", str(line).c_str());
         
-        for_<Component::ComponentType>([&](auto i){
-            using C = std::variant_alternative_t<i.value, Component::ComponentType>;
-            
-            if (lower(str(type_name<C>())) == current_component) {
-                C* component = scene_list.at(scene).getComponent<C>(eid);
-                Reflection::apply(component, item_name, [item_value](auto *c){ assignFromString(*c, item_value); } );
-                component_found = true;
-            }
-        });
-        
-        if (not component_found) log::error("You tried to load a component with an incorrect name, %s", current_component.c_str());
+        Components::assign.at(current_component)(scene, eid, trimmed(line.substr(0, separator)), line.substr(separator + 1));
     }
     
     //: Get the component name
     if (state == LOAD_COMPONENT_NAME) {
-        current_component = lower(line.substr(ind * 2, line.find(":") - ind * 2));
+        std::string_view name = trimmed(line.substr(0, line.find(":")));
+        current_component = Components::find(name);
+        if (current_component == -1) log::error("The component '%s' is invalid, check the spelling", str(name).c_str());
         
-        if (add_components) {
-            for_<Component::ComponentType>([&](auto i){
-                using C = std::variant_alternative_t<i.value, Component::ComponentType>;
-                
-                if (lower(str(type_name<C>())) == current_component) {
-                    scene_list.at(scene).addComponent<C>(eid);
-                    state = LOAD_COMPONENT_BODY;
-                }
-            });
-            
-            if (state == LOAD_COMPONENT_NAME) log::error("The component '%s' is invalid, check the spelling", current_component.c_str());
-        } else {
-            state = LOAD_COMPONENT_BODY;
-        }
+        if (add_components)
+            Components::add.at(current_component)(scene, eid);
+        state = LOAD_COMPONENT_BODY;
     }
 }
 
 EntityID Serialization::loadEntity(str file, SceneID scene_id, str name) {
+    return loadEntity(file, scene_list.at(scene_id), name);
+}
+
+EntityID Serialization::loadEntity(str file, Scene &scene, str name) {
     EntityID id = -1;
     str entity_name;
     
     //: Load file
-    str path = File::path("data/entities/" + file);
-    std::ifstream f(path);
+    str buffer = readFile(File::path("data/entities/" + file));
     LoadState state = LOAD_NAME;
     
     //: Line by line
-    str s;
-    while (std::getline(f, s)) {
+    Tokenizer lines(buffer, "\n");
+    std::string_view s;
+    while (nextLine(lines, s)) {
         //: Indentation
         int indentation = getIndentation(s);
         if (indentation == -1) continue;
         
         //: Entity name
         if (state == LOAD_NAME) {
-            auto l = split(s);
-            if (l.size() != 2) log::error("You loaded an invalid entity, first line must be 'entity name', name can't contain spaces. %s", s.c_str());
+            std::array<std::string_view, 2> l;
+            if (Tokenizer(trimmed(s), " ", true).next(l) != 2) log::error("You loaded an invalid entity, first line must be 'entity name', name can't contain spaces. %s", str(s).c_str());
             if (l.at(0) != "entity") log::error("You loaded an invalid entity, please make sure that the file starts with 'entity'");
-            entity_name = name == "" ? l.at(1) : name;
-            id = scene_list.at(scene_id).createEntity(entity_name);
+            entity_name = name == "" ? str(l.at(1)) : name;
+            id = scene.createEntity(entity_name);
             state = LOAD_FRONTMATTER;
             continue;
         }
@@ -105,7 +196,7 @@ EntityID Serialization::loadEntity(str file, SceneID scene_id, str name) {
         }
         
         //: Components
-        loadComponents(s, state, scene_id, id, indentation);
+        loadComponents(s, state, scene, id, indentation);
     }
     
     return id;
@@ -113,28 +204,56 @@ EntityID Serialization::loadEntity(str file, SceneID scene_id, str name) {
 
 
 SceneID Serialization::loadScene(str file) {
-    SceneID scene_id = -1;
+    SceneID scene_id = registerScene("");
+    loadScene(file, scene_list.at(scene_id));
+    return scene_id;
+}
+
+void Serialization::loadSceneAsync(str file) {
+    //: It uses its own thread instead of the job system, since a thread waiting for jobs could pick it up and stall the frame
+    //  Destroying the future of a load that is still running would wait for it, so they are kept until they finish. If a load starts
+    //  before the previous one ends, only the last one is queued. Errors are reported as warnings, the active scene doesn't change
+    static std::vector<std::future<void>> loading;
+    static std::atomic<ui32> latest = 0;
+    std::erase_if(loading, [](auto &f){ return f.wait_for(std::chrono::seconds(0)) == std::future_status::ready; });
+    
+    ui32 id = ++latest;
+    loading.push_back(std::async(std::launch::async, [file, id](){
+        try {
+            auto scene = std::make_unique<Scene>();
+            loadScene(file, *scene);
+            if (id == latest) {
+                queueScene(std::move(scene));
+                queue_scene_loaded.push(file);
+            }
+        } catch (const std::exception &e) {
+            log::warn("Couldn't load the scene %s in the background: %s", file.c_str(), e.what());
+        }
+    }));
+}
+
+void Serialization::loadScene(str file, Scene &scene) {
     EntityID current_eid = -1;
     bool add_components = true;
     
     //: Load file
-    str path = File::path("data/scenes/" + file);
-    std::ifstream f(path);
+    str buffer = readFile(File::path("data/scenes/" + file));
     LoadState state = LOAD_NAME;
     
     //: Line by line
-    str s;
-    while (std::getline(f, s)) {
+    Tokenizer lines(buffer, "\n");
+    std::string_view s;
+    while (nextLine(lines, s)) {
         //: Indentation
         int indentation = getIndentation(s);
         if (indentation == -1) continue;
         
         //: Scene name
         if (state == LOAD_NAME) {
-            auto l = split(s);
-            if (l.size() != 2) log::error("You loaded an invalid scene, first line must be 'scene name', name can't contain spaces. %s", s.c_str());
+            std::array<std::string_view, 2> l;
+            if (Tokenizer(trimmed(s), " ", true).next(l) != 2) log::error("You loaded an invalid scene, first line must be 'scene name', name can't contain spaces. %s", str(s).c_str());
             if (l.at(0) != "scene") log::error("You loaded an invalid scene, please make sure that the file starts with 'scene'");
-            scene_id = registerScene(l.at(1));
+            scene.name = l.at(1);
             state = LOAD_FRONTMATTER;
             continue;
         }
@@ -151,29 +270,28 @@ SceneID Serialization::loadScene(str file) {
         //: Load compontents
         if (state == LOAD_COMPONENT_NAME or state == LOAD_COMPONENT_BODY) {
             if (indentation == 0) state = LOAD_SCENE_ENTITY;
-            loadComponents(s, state, scene_id, current_eid, indentation, 1, add_components);
+            loadComponents(s, state, scene, current_eid, indentation, 1, add_components);
         }
         
         //: Load entity
         if (state == LOAD_SCENE_ENTITY) {
-            auto l = split(s.substr(0, s.find(":")));
+            std::array<std::string_view, 3> l;
+            size_t parts = Tokenizer(trimmed(s.substr(0, s.find(":"))), " ", true).next(l);
             if (l.at(0) != "entity") log::error("You loaded an invalid entity, please make sure that the file starts with 'entity'");
             
-            if (l.size() == 2) { //: Entity from scratch
-                current_eid = scene_list.at(scene_id).createEntity(l.at(1));
+            if (parts == 2) { //: Entity from scratch
+                current_eid = scene.createEntity(str(l.at(1)));
                 state = LOAD_COMPONENT_NAME;
                 add_components = true;
                 continue;
-            } else if (l.size() == 3) { //: Entity from template
-                current_eid = loadEntity(l.at(2), scene_id, l.at(1));
+            } else if (parts == 3) { //: Entity from template
+                current_eid = loadEntity(str(l.at(2)), scene, str(l.at(1)));
                 state = LOAD_COMPONENT_NAME;
                 add_components = false;
                 continue;
             } else {
-                log::error("You loaded an invalid entity, the name must be either 'entity name:' or 'entity template name:'. %s", s.c_str());
+                log::error("You loaded an invalid entity, the name must be either 'entity name:' or 'entity template name:'. %s", str(s).c_str());
             }
         }
     }
-    
-    return scene_id;
 }
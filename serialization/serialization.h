@@ -6,6 +6,7 @@
 
 #include "scene.h"
 #include "log.h"
+#include "event_queue.h"
 #include <charconv>
 
 namespace Fresa::Serialization
@@ -18,55 +19,64 @@ namespace Fresa::Serialization
         LOAD_SCENE_ENTITY,
     };
     
-    int getIndentation(const str &line);
-    void loadComponents(const str &line, LoadState &state, SceneID scene, EntityID eid, int ind, int base_ind = 0, bool add_components = true);
+    int getIndentation(std::string_view line);
+    void loadComponents(std::string_view line, LoadState &state, Scene &scene, EntityID eid, int ind, int base_ind = 0, bool add_components = true);
+    EntityID loadEntity(str file, Scene &scene, str name = "");
     EntityID loadEntity(str file, SceneID scene_id, str name = "");
+    
+    //: Loads a scene file, registering it in the scene list or into a scene that is not registered
     SceneID loadScene(str file);
+    void loadScene(str file, Scene &scene);
+    
+    //: Loads the scene in a background thread and queues it to become the active scene when it is ready (see queueScene), called from the
+    //      main thread. It never waits for a previous load, and a load that fails only logs a warning
+    void loadSceneAsync(str file);
+    
+    //: Published on the main thread with the file name when a scene loaded with loadSceneAsync is queued. The loader thread pushes it to
+    //      the queue, so it arrives at the start of a frame, right before the scene is swapped or the frame after
+    inline Event::LocalEvent<str> event_scene_loaded;
+    inline Event::EventQueue<str> queue_scene_loaded{event_scene_loaded, Event::QUEUE_LAST};
     
     template <typename T>
-    void assignFromString(T &x, str s) {
+    void assignFromString(T &x, std::string_view s) {
+        s = trimmed(s);
+        
         //: Strings
         if constexpr (std::is_same_v<T, str>)
             x = s;
         
-        //: Integral
-        if constexpr (std::is_integral_v<T>)
-            std::from_chars(s.data(), s.data() + s.size(), x);
-        
-        //: Floating (from_chars is still not implemented for floating point values)
-        if constexpr (std::is_same_v<T, float>)
-            x = std::stof(s);
-        if constexpr (std::is_same_v<T, double>)
-            x = std::stod(s);
-        if constexpr (std::is_same_v<T, long double>)
-            x = std::stold(s);
+        //: Integral and floating (from_chars doesn't accept a leading '+', stof did)
+        if constexpr (std::is_arithmetic_v<T>) {
+            const char* begin = s.data() + (s.size() > 1 and s.front() == '+');
+            const char* end = s.data() + s.size();
+            auto [ptr, ec] = std::from_chars(begin, end, x);
+            if (ec != std::errc{} or ptr != end) log::error("The number format is incorrect or out of range, %s", str(s).c_str());
+        }
         
         //: Vec2 (Format: [x, y])
         if constexpr (is_vec2<T>::value) {
-            auto v = split(list_contents(s), ",");
-            if (v.size() != 2) log::error("The Vec2 format is incorrect, %s", s.c_str());
-            std::for_each(v.begin(), v.end(), trim);
+            std::array<std::string_view, 2> v;
+            if (Tokenizer(list_contents(s), ",").next(v) != 2) log::error("The Vec2 format is incorrect, %s", str(s).c_str());
             assignFromString(x.x, v.at(0));
             assignFromString(x.y, v.at(1));
         }
         
         //: Rect2
         if constexpr (is_rect2<T>::value) {
-            auto v = split(list_contents(s), ",");
-            if (v.size() != 4) log::error("The Rect2 format is incorrect, %s", s.c_str());
-            std::for_each(v.begin(), v.end(), trim);
+            std::array<std::string_view, 4> v;
+            if (Tokenizer(list_contents(s), ",").next(v) != 4) log::error("The Rect2 format is incorrect, %s", str(s).c_str());
             assignFromString(x.x, v.at(0)); assignFromString(x.y, v.at(1));
             assignFromString(x.w, v.at(2)); assignFromString(x.h, v.at(3));
         }
         
         //: std::vector
         if constexpr (is_vector<T>::value) {
-            auto v = split(list_contents(s), ",");
-            x.resize(v.size());
-            for (int i = 0; i < v.size(); i++) {
-                trim(v.at(i));
-                assignFromString(x.at(i), v.at(i));
-            }
+            std::string_view contents = list_contents(s);
+            x.resize(trimmed(contents).empty() ? 0 : std::count(contents.begin(), contents.end(), ',') + 1);
+            Tokenizer t(contents, ",");
+            std::string_view item;
+            for (size_t i = 0; i < x.size() and t.next(item); i++)
+                assignFromString(x.at(i), item);
         }
     }
 }